@@ -5,6 +5,8 @@ CONFIG -= app_bundle
 
 INCLUDEPATH += jMUD/src/utilities jMUD/src/config
 
+LIBS += -lz
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
@@ -17,14 +19,24 @@ SOURCES += \
     jMUD/src/game/System.cpp \
     jMUD/src/game/SystemManager.cpp \
     jMUD/src/main.cpp \
+    jMUD/src/server/ConnectionTimeouts.cpp \
     jMUD/src/server/DataEngine.cpp \
     jMUD/src/server/GameEngine.cpp \
     jMUD/src/server/GameServer.cpp \
     jMUD/src/server/Player.cpp \
+    jMUD/src/server/ThreadPlacement.cpp \
+    jMUD/src/server/network/NetworkBuffer.cpp \
+    jMUD/src/server/network/NetworkCompress.cpp \
     jMUD/src/server/network/NetworkEngine.cpp \
     jMUD/src/server/network/NetworkEngineAccept.cpp \
     jMUD/src/server/network/NetworkEngineRecv.cpp \
     jMUD/src/server/network/NetworkEngineSend.cpp \
+    jMUD/src/server/network/NetworkMessagePool.cpp \
+    jMUD/src/server/network/NetworkResolver.cpp \
+    jMUD/src/server/network/NetworkSocketTable.cpp \
+    jMUD/src/server/network/NetworkStats.cpp \
+    jMUD/src/server/network/NetworkTelnet.cpp \
+    jMUD/src/server/network/NetworkUring.cpp \
     jMUD/src/server/world/WorldEngine.cpp \
     jMUD/src/server/world/WorldRoom.cpp \
     jMUD/src/server/world/WorldZone.cpp \
@@ -53,22 +65,36 @@ HEADERS += \
     jMUD/src/game/EntityManager.h \
     jMUD/src/game/System.h \
     jMUD/src/game/SystemManager.h \
+    jMUD/src/server/ConnectionTimeouts.h \
     jMUD/src/server/DataEngine.h \
     jMUD/src/server/GameEngine.h \
     jMUD/src/server/GameServer.h \
     jMUD/src/server/Player.h \
+    jMUD/src/server/ThreadPlacement.h \
+    jMUD/src/server/network/NetworkBuffer.h \
+    jMUD/src/server/network/NetworkCompress.h \
     jMUD/src/server/network/NetworkCore.h \
     jMUD/src/server/network/NetworkEngine.h \
     jMUD/src/server/network/NetworkEngineAccept.h \
     jMUD/src/server/network/NetworkEngineRecv.h \
     jMUD/src/server/network/NetworkEngineSend.h \
     jMUD/src/server/network/NetworkEngineThread.h \
+    jMUD/src/server/network/NetworkMessagePool.h \
+    jMUD/src/server/network/NetworkRateLimit.h \
+    jMUD/src/server/network/NetworkResolver.h \
+    jMUD/src/server/network/NetworkSocketTable.h \
+    jMUD/src/server/network/NetworkStats.h \
+    jMUD/src/server/network/NetworkTelnet.h \
+    jMUD/src/server/network/NetworkUring.h \
     jMUD/src/server/world/WorldEngine.h \
     jMUD/src/server/world/WorldRoom.h \
     jMUD/src/server/world/WorldZone.h \
     jMUD/src/server/world/world.h \
+    jMUD/src/utilities/Histogram.h \
+    jMUD/src/utilities/QueueMPSC.h \
+    jMUD/src/utilities/QueueSPSC.h \
     jMUD/src/utilities/Settings.h \
+    jMUD/src/utilities/TimingWheel.h \
     jMUD/src/utilities/UnorderedArray.h \
-    jMUD/src/utilities/UnorderedQueueMT.h \
     jMUD/src/utilities/gamelog.h \
     jMUD/src/utilities/log.h
@@ -0,0 +1,131 @@
+/******************************************************************************
+ * file: ConnectionTimeouts.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "ConnectionTimeouts.h"
+#include "network/NetworkEngine.h"
+
+#include <cstring>      // strlen()
+
+
+ConnectionTimeouts::ConnectionTimeouts(void) :
+    connections(),
+    wheel(),
+    ticks_per_second(1),
+    n_voided(0),
+    n_closed(0)
+{
+}
+
+
+void ConnectionTimeouts::initialize(uint64_t ticksPerSecond) {
+    ticks_per_second = (ticksPerSecond > 0) ? ticksPerSecond : 1;
+}
+
+
+/***
+ * Starts the connect timeout of a new connection. A connection that is there
+ * already (the cid was reused) starts over.
+ */
+void ConnectionTimeouts::Add(net::ConnectionID cid, uint64_t tick) {
+    Connection& c = connections[cid];
+    c.cid = cid;
+    c.phase = Connecting;
+    c.connected = tick;
+    c.last_activity = tick;
+    wheel.schedule(&c, deadline(c));
+}
+
+
+void ConnectionTimeouts::Remove(net::ConnectionID cid) {
+    auto it = connections.find(cid);
+    if (it == connections.end())
+        return;
+
+    wheel.cancel(&it->second);
+    connections.erase(it);
+}
+
+
+/***
+ * Notes that the connection was active on the tick. Only a voided connection
+ * needs its timer moved, its deadline is the only one that comes closer.
+ */
+void ConnectionTimeouts::Activity(net::ConnectionID cid, uint64_t tick) {
+    auto it = connections.find(cid);
+    if (it == connections.end())
+        return;
+
+    Connection& c = it->second;
+    c.last_activity = tick;
+    if (c.phase == Connecting) {
+        c.phase = Active;
+    } else if (c.phase == Voided) {
+        sys::log::GameEngine::debug("Connection cid = %u is back from the void", cid);
+        c.phase = Active;
+        wheel.schedule(&c, deadline(c));
+    }
+}
+
+
+void ConnectionTimeouts::Advance(uint64_t tick) {
+    wheel.advance(tick, [this](Wheel::Timer* t) {expire(static_cast<Connection*>(t));});
+}
+
+
+uint64_t ConnectionTimeouts::deadline(const Connection& c) const {
+    switch (c.phase) {
+    case Connecting:
+        return c.connected + TIME_ConnectTimeout * ticks_per_second;
+    case Active:
+        return c.last_activity + TIME_IdleVoid * ticks_per_second;
+    case Voided:
+        return c.last_activity + TIME_IdleDisconnect * ticks_per_second;
+    }
+    return c.last_activity;
+}
+
+
+/***
+ * Called when the connection's timer fires. If it has been active since the
+ * timer was set, the timer is just set again for the new deadline. Otherwise
+ * an active connection is voided, anything else is closed. A closed connection
+ * is forgotten right away, the Disconnection message that follows finds
+ * nothing to remove.
+ */
+void ConnectionTimeouts::expire(Connection* c) {
+    uint64_t now = wheel.now();
+    uint64_t due = deadline(*c);
+    if (due > now) {
+        wheel.schedule(c, due);
+        return;
+    }
+
+    if (c->phase == Active) {
+        const char* msg = "You have been idle, and are pulled into a void.\r\n";
+        sys::log::GameEngine::add("Connection cid = %u idle for %lu s, voided", c->cid, TIME_IdleVoid);
+        net::NetworkEngine::instance().SendTickData(c->cid, msg, strlen(msg));
+        c->phase = Voided;
+        ++n_voided;
+        wheel.schedule(c, deadline(*c));
+        return;
+    }
+
+    if (c->phase == Connecting)
+        sys::log::GameEngine::add("Connection cid = %u timed out connecting, closing it", c->cid);
+    else
+        sys::log::GameEngine::add("Connection cid = %u idle for %lu s, closing it", c->cid, TIME_IdleDisconnect);
+    net::ConnectionID cid = c->cid;
+    net::NetworkEngine::instance().CloseConnection(cid);
+    ++n_closed;
+    connections.erase(cid);
+}
+
+
+void ConnectionTimeouts::LogStatus(void) {
+    sys::log::GameEngine::add("timeouts: %lu connection(s) timed, %lu voided, %lu closed", wheel.size(), n_voided, n_closed);
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+ * file: ConnectionTimeouts.h
+ *
+ * description: Connect and idle timeouts of the game's connections, run by
+ *              the game-thread once per tick. A connection that hasn't got
+ *              past connecting within TIME_ConnectTimeout is closed, one idle
+ *              for TIME_IdleVoid is voided and after TIME_IdleDisconnect it is
+ *              closed. Every connection has one timer in a TimingWheel, so a
+ *              tick only costs the timers that are due, not a pass over all
+ *              connections. Activity just records the tick it happened on,
+ *              a timer that fires for a connection that has been active since
+ *              is moved on to its new deadline.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef CONNECTIONTIMEOUTS_H
+#define CONNECTIONTIMEOUTS_H
+
+#include "config.h"
+#include "network/NetworkCore.h"
+#include "TimingWheel.h"
+
+#include <cstdint>          // uint64_t
+#include <unordered_map>    // std::unordered_map<K, T>
+
+
+class ConnectionTimeouts {
+  public:
+    ConnectionTimeouts(void);
+
+    void initialize(uint64_t ticksPerSecond);
+
+    void Add(net::ConnectionID cid, uint64_t tick);         // On NewConnection.
+    void Remove(net::ConnectionID cid);                     // On Disconnection.
+    void Activity(net::ConnectionID cid, uint64_t tick);    // On input from the connection.
+    void Advance(uint64_t tick);    // Voids and closes the connections whose time is up. Once per tick.
+
+    std::size_t size(void) const {return connections.size();}
+    void        LogStatus(void);
+
+  private:
+    ConnectionTimeouts(const ConnectionTimeouts&);
+    ConnectionTimeouts& operator=(const ConnectionTimeouts&);
+
+    typedef TimingWheel<> Wheel;
+
+    // NOTE: Until there is a login, the first input from a connection ends its connect phase.
+    enum Phase {Connecting, Active, Voided};
+
+    struct Connection : public Wheel::Timer {
+        net::ConnectionID cid;
+        Phase             phase;
+        uint64_t          connected;        // Tick it connected on.
+        uint64_t          last_activity;    // Tick of its last input.
+    };
+
+    uint64_t deadline(const Connection& c) const;
+    void     expire(Connection* c);
+
+    std::unordered_map<net::ConnectionID, Connection> connections;  // NOTE: Elements never move, the wheel links them.
+    Wheel    wheel;
+    uint64_t ticks_per_second;
+
+    uint64_t n_voided;
+    uint64_t n_closed;
+};
+
+
+#endif // CONNECTIONTIMEOUTS_H
@@ -19,11 +19,13 @@
 #include "DataEngine.h"
 #include "world/WorldEngine.h"
 #include "network/NetworkEngine.h"
+#include "ThreadPlacement.h"
 
 
 #include <cstdlib>
 #include <ctime>
 #include <cstring>
+#include <chrono>
 #include <fstream>
 
 
@@ -59,7 +61,9 @@ GameEngine::GameEngine(void) :
     time_now(0),
     _network_io(),
     mutex_network_io(),
-    _players()
+    _players(),
+    _timeouts(),
+    _input_wait()
 {
 }
 
@@ -158,8 +162,8 @@ int GameEngine::shutdown(int err) {
 
     // TODO: Shutdown WorldEngine
 
-    // TODO: Shutdown NetworkEngine
-    net::NetworkEngine::instance().close();
+    // NOTE: A game loop that ran its course is an automatic reboot, anything else a manual shutdown.
+    net::NetworkEngine::instance().close((err == 0) ? MSG_AutoReboot : MSG_GameShutdown);
 
     // TOOD: Shutdown DataEngine
 
@@ -198,10 +202,16 @@ int GameEngine::run(void) {
     running = true;
     sys::log::GameEngine::add("*** GAME IS STARTED ***");
 
+    // NOTE: Pinned only now, after the network threads are started, since threads inherit the CPUs of the
+    //       thread spawning them.
+    ThreadPlacement::instance().place(ThreadPlacement::Game, "GameEngine");
+
     const unsigned int cycle_length = 250;
 //    const unsigned int shutdown_at_cycle_count = (1000 / 250) * 60 * 240;   // =  4 hours
 //    const unsigned int shutdown_at_cycle_count = (1000 / 250) * 60 * 10;      // = 10 minutes
     const unsigned int shutdown_at_cycle_count = (1000 / 250) * 30;           // = 30 seconds
+    const unsigned int log_input_wait_cycles = (1000 / cycle_length) * 60;     // = 1 minute
+    _timeouts.initialize(1000 / cycle_length);
 
     // Boot the game and if no errors are reported then we are ready to roll.
     sys::log::GameEngine::add("Entering GameLoop ...");
@@ -218,17 +228,26 @@ int GameEngine::run(void) {
         // TODO: Add player input handling.
         if (update() < 0)
             break;
+        _timeouts.Advance(_cycle_count);
 
         // TODO: Add world updates.
 
+        // All output of the tick goes out together, one write per connection.
+        net::NetworkEngine::instance().FlushTickOutput();
+
+        if (_cycle_count % log_input_wait_cycles == 0)
+            LogInputWait();
+
         // FIXME: Change so that we only sleep the remainder of the cycle time, if any.
         this->sleep(cycle_length);
 
     } while (runStatus == true && _cycle_count < shutdown_at_cycle_count);
 
     sys::log::GameEngine::add("Exiting GameLoop.");
+    _timeouts.LogStatus();
+    LogInputWait();
     sys::log::GameEngine::add("*** GAME IS CLOSING ***");
-    return shutdown(0);
+    return shutdown(errorCode);
 }
 
 
@@ -240,32 +259,49 @@ int  GameEngine::update(void) {
         unsigned int nAdd = 0, nRem = 0, nDataIn = 0, nError = 0;
 
         sys::log::GameEngine::debug("update(): %lu players - processing %lu input messages", DataEngine::instance().GetNumPlayers(), _network_io.size());
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
         while (!_network_io.empty()) {
-            m = _network_io.top();
+            m = _network_io.front();
             _network_io.pop();
 
             switch (m->type) {
             case net::MessageTypes::NewConnection:
                 sys::log::GameEngine::add("Adding player connection cid = %u", m->cid);
                 DataEngine::instance().AddPlayer(m->cid);
+                _timeouts.Add(m->cid, _cycle_count);
                 nAdd++;
                 break;
              case net::MessageTypes::Disconnection:
                 sys::log::GameEngine::add("Removing player connection cid = %u", m->cid);
                 DataEngine::instance().RemPlayer(m->cid);
+                _timeouts.Remove(m->cid);
                 nRem++;
                 break;
             case net::MessageTypes::DataIncoming:
                 if (m->size == 0) {
                     sys::log::GameEngine::error("Received a NetworkMessage with type=DataIncoming which had a data size of 0. Should never happen.");
                 }
+                _timeouts.Activity(m->cid, _cycle_count);
+                if (now > m->received_at)
+                    _input_wait.record(std::chrono::duration_cast<std::chrono::microseconds>(now - m->received_at).count());
+                else
+                    _input_wait.record(0);
                 nDataIn++;
                 break;
             case net::MessageTypes::DataOutgoing:
                 sys::log::GameEngine::error("Received a NetworkMessage with type=DataOutgoing. Should never happen.");
                 nError++;
                 break;
+            case net::MessageTypes::CompressStart:
+                sys::log::GameEngine::error("Received a NetworkMessage with type=CompressStart. Should never happen.");
+                nError++;
+                break;
+            case net::MessageTypes::CloseConnection:
+                sys::log::GameEngine::error("Received a NetworkMessage with type=CloseConnection. Should never happen.");
+                nError++;
+                break;
             case net::MessageTypes::DNSLookup:
+                sys::log::GameEngine::add("Player connection cid = %u is from %s", m->cid, m->data);
                 break;
             }
 
@@ -279,6 +315,22 @@ int  GameEngine::update(void) {
 }
 
 
+/***
+ * Logs how long input waited before the game got to it, over the time since
+ * the last call. This is the lag the players see on top of the network's,
+ * mostly made up of waiting for the next tick.
+ */
+void GameEngine::LogInputWait(void) {
+    if (_input_wait.count() == 0)
+        return;
+
+    sys::log::GameEngine::add("input wait: %lu line(s), mean %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, p99.9 %.1f ms, max %.1f ms",
+            _input_wait.count(), _input_wait.mean() / 1000.0, _input_wait.percentile(50) / 1000.0, _input_wait.percentile(90) / 1000.0,
+            _input_wait.percentile(99) / 1000.0, _input_wait.percentile(99.9) / 1000.0, _input_wait.max() / 1000.0);
+    _input_wait.clear();
+}
+
+
 /***
  * Returns a millisecond resolution timer, that usually represents the number
  * of milliseconds since boot though that is irrelevant for us.
@@ -498,6 +550,8 @@ void GameEngine::LogSystemInfo(void) {
     } else {
         sys::log::add("  RAM: information unavailable");
     }
+
+    ThreadPlacement::instance().LogLayout();
 }
 
 
@@ -13,9 +13,12 @@
 
 #include "config.h"
 #include "network/NetworkCore.h"
+#include "ConnectionTimeouts.h"
 #include "Player.h"
+#include "Histogram.h"
 
-#include <stack>        // std::stack<T>
+#include <atomic>       // std::atomic<T>
+#include <queue>        // std::queue<T>
 #include <mutex>        // std::mutex
 #include <list>         // std::list<T>
 
@@ -33,6 +36,7 @@ class GameEngine {
     bool initialize(void);
     int  run(void);
     int  shutdown(int err = 0);
+    void stop(int err) {errorCode = err; runStatus = false;}   // Ends the game loop after this tick. Signal safe.
 
     uint64_t GetCycleCount(void) {return _cycle_count;}
 
@@ -42,6 +46,7 @@ class GameEngine {
 
     void LogSystemInfo(void);
     void LogSystemUsage(void);
+    void LogInputWait(void);
 
     void AddMessageRecv(net::NetworkMessage* m);
 
@@ -57,8 +62,8 @@ class GameEngine {
     void sleep(unsigned int mseconds);
     void sleep(struct timespec t);
 
-    bool runStatus;
-    int errorCode;
+    std::atomic<bool> runStatus;
+    std::atomic<int>  errorCode;    // Why the game loop was stopped, 0 when it ran its course.
 
     bool running;
     bool booted;
@@ -68,10 +73,13 @@ class GameEngine {
     time_t time_boot;               // Gets updated at boot.
     time_t time_now;                // Time "now".
 
-    std::stack<net::NetworkMessage*> _network_io;  // Incoming data
+    std::queue<net::NetworkMessage*> _network_io;  // Incoming data, in the order it arrived.
     std::mutex mutex_network_io;
 
     std::list<Player*> _players;
+
+    ConnectionTimeouts _timeouts;   // Idle and connect timeouts, advanced each tick.
+    Histogram _input_wait;          // How long (us) input waited, from the kernel getting it until processed.
 };
 
 
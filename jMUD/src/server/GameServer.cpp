@@ -107,7 +107,8 @@ void GameServer::printHelp(void) {
 void signal_handler(int sig) {
     switch (sig) {
         case SIGINT:
-            GameEngine::instance().shutdown(SIGINT);
+            // NOTE: The game-thread shuts down once its current tick is done, there is no waiting in here.
+            GameEngine::instance().stop(SIGINT);
             break;
 
         default:
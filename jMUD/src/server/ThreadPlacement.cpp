@@ -0,0 +1,264 @@
+/******************************************************************************
+ * file: ThreadPlacement.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "ThreadPlacement.h"
+
+#include <cstdio>       // snprintf()
+#include <cstdlib>      // strtol()
+#include <cstring>      // strerror()
+#include <fstream>
+
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+    #include <pthread.h>    // pthread_setaffinity_np()
+    #include <unistd.h>     // sysconf()
+#endif
+
+
+/***
+ * Reads the policy of each role from the settings, and which CPUs belong to
+ * which NUMA node from sysfs.
+ */
+ThreadPlacement::ThreadPlacement(void)
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        : policy(), cpu_node(), nodes(0)
+    #endif
+{
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        load_topology();
+
+        for (int r = 0; r < NumRoles; r++) {
+            Policy& p = policy[r];
+            CPU_ZERO(&p.cpus);
+
+            const char* list = settings.getSetting(role_key(static_cast<Role>(r)));
+            if (list == NULL)
+                continue;
+            if (parse_cpus(list, &p.cpus) == false) {
+                sys::log::warning("Invalid CPU list '%s' for '%s', %s threads will not be pinned.", list, role_key(static_cast<Role>(r)), role_name(static_cast<Role>(r)));
+                CPU_ZERO(&p.cpus);
+                continue;
+            }
+
+            // NOTE: Recv-threads are given the CPUs one node at a time, so with more than one node in the list
+            //       consecutive recv-threads (and their connections and buffers) end up on different nodes.
+            std::vector<std::vector<int> > by_node(static_cast<std::size_t>(nodes) + 1);  // [0] for unknown node.
+            std::size_t most = 0;
+            for (std::size_t cpu = 0; cpu < cpu_node.size(); cpu++) {
+                if (!CPU_ISSET(cpu, &p.cpus))
+                    continue;
+                std::vector<int>& group = by_node[static_cast<std::size_t>(cpu_node[cpu] + 1)];
+                group.push_back(static_cast<int>(cpu));
+                most = (group.size() > most) ? group.size() : most;
+            }
+            for (std::size_t i = 0; i < most; i++) {
+                for (std::size_t g = 0; g < by_node.size(); g++) {
+                    if (i < by_node[g].size())
+                        p.order.push_back(by_node[g][i]);
+                }
+            }
+        }
+    #endif
+}
+
+
+/***
+ * Pins the calling thread to the CPUs of its role. Recv-threads get a single
+ * CPU each, round-robin over the list. Returns false if the pinning failed,
+ * the thread then keeps running wherever the scheduler puts it.
+ */
+bool ThreadPlacement::place(Role role, const char* name) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        Policy& p = policy[role];
+        if (p.order.empty()) {
+            sys::log::debug("<%s> not pinned to any CPU.", name);
+            return true;
+        }
+
+        cpu_set_t set;
+        if (role == Recv) {
+            CPU_ZERO(&set);
+            CPU_SET(p.order[p.next.fetch_add(1, std::memory_order_relaxed) % p.order.size()], &set);
+        } else {
+            set = p.cpus;
+        }
+
+        char cpus[128];
+        format_cpus(&set, cpus, sizeof(cpus));
+        int e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (e != 0) {
+            sys::log::warning("<%s> Failed to pin thread to CPU(s) %s. (%i:%s)", name, cpus, e, strerror(e));
+            return false;
+        }
+
+        // Report the node if all the CPUs are on the same one.
+        int node = -2;
+        for (std::size_t cpu = 0; cpu < cpu_node.size(); cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                node = (node == -2 || node == cpu_node[cpu]) ? cpu_node[cpu] : -1;
+        }
+        if (node >= 0)
+            sys::log::add("<%s> pinned to CPU(s) %s (node %i)", name, cpus, node);
+        else
+            sys::log::add("<%s> pinned to CPU(s) %s", name, cpus);
+        return true;
+    #else
+        sys::log::debug("<%s> not pinned to any CPU (unsupported on this platform).", name);
+        return true;
+    #endif
+}
+
+
+/***
+ * Logs the NUMA nodes and the CPUs of each role.
+ */
+void ThreadPlacement::LogLayout(void) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        char cpus[128];
+        cpu_set_t set;
+
+        if (nodes == 0) {
+            sys::log::add("  NUMA: information unavailable");
+        } else {
+            sys::log::add("  NUMA: %i node(s)", nodes);
+            for (int node = 0; node < nodes; node++) {
+                CPU_ZERO(&set);
+                for (std::size_t cpu = 0; cpu < cpu_node.size(); cpu++) {
+                    if (cpu_node[cpu] == node)
+                        CPU_SET(cpu, &set);
+                }
+                format_cpus(&set, cpus, sizeof(cpus));
+                sys::log::add("    node%i: CPU(s) %s", node, cpus);
+            }
+        }
+
+        sys::log::add("  Thread placement:");
+        for (int r = 0; r < NumRoles; r++) {
+            if (policy[r].order.empty()) {
+                sys::log::add("    %-7s: not pinned", role_name(static_cast<Role>(r)));
+                continue;
+            }
+            format_cpus(&policy[r].cpus, cpus, sizeof(cpus));
+            sys::log::add("    %-7s: CPU(s) %s%s", role_name(static_cast<Role>(r)), cpus, (r == Recv) ? " (one per thread)" : "");
+        }
+    #else
+        sys::log::add("  Thread placement: unsupported on this platform");
+    #endif
+}
+
+
+const char* ThreadPlacement::role_name(Role role) {
+    switch (role) {
+    case Game:   return "game";
+    case Accept: return "accept";
+    case Recv:   return "recv";
+    case Send:   return "send";
+    default:     return "<unknown>";
+    }
+}
+
+
+const char* ThreadPlacement::role_key(Role role) {
+    switch (role) {
+    case Game:   return "server.cpus.game";
+    case Accept: return "server.cpus.accept";
+    case Recv:   return "server.cpus.recv";
+    case Send:   return "server.cpus.send";
+    default:     return "";
+    }
+}
+
+
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+/***
+ * Maps each configured CPU to its NUMA node, going by the cpulist of every
+ * node in sysfs.
+ */
+// NOTE: Stops at the first missing node, so a machine with holes in its node numbering only gets the nodes
+//       before the first hole.
+void ThreadPlacement::load_topology(void) {
+    long n = sysconf(_SC_NPROCESSORS_CONF);
+    if (n < 1)
+        n = 1;
+    cpu_node.assign(static_cast<std::size_t>(n), -1);
+
+    for (nodes = 0; ; nodes++) {
+        char path[64], read_buf[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%i/cpulist", nodes);
+        std::fstream cpulist(path, std::ios::in);
+        if (cpulist.is_open() == 0)
+            break;
+        cpulist.getline(read_buf, sizeof(read_buf), '\n');
+
+        cpu_set_t set;
+        if (parse_cpus(read_buf, &set) == false)
+            continue;
+        for (std::size_t cpu = 0; cpu < cpu_node.size(); cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                cpu_node[cpu] = nodes;
+        }
+    }
+}
+
+
+/***
+ * Parses a CPU list like "0-3,8,10-11" (the format used by sysfs and taskset).
+ */
+bool ThreadPlacement::parse_cpus(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    if (list == NULL || list[0] == '\0')
+        return false;
+
+    const char* p = list;
+    while (*p != '\0') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+
+        if (*p == ',')
+            ++p;
+        else if (*p != '\0')
+            return false;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+
+void ThreadPlacement::format_cpus(const cpu_set_t* set, char* buf, std::size_t size) {
+    std::size_t length = 0;
+    buf[0] = '\0';
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && length < size; cpu++) {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+            ++last;
+
+        int written;
+        if (last == cpu)
+            written = snprintf(buf + length, size - length, "%s%i", (length > 0) ? "," : "", cpu);
+        else
+            written = snprintf(buf + length, size - length, "%s%i-%i", (length > 0) ? "," : "", cpu, last);
+        if (written < 0)
+            break;
+        length += static_cast<std::size_t>(written);
+        cpu = last;
+    }
+}
+#endif // (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
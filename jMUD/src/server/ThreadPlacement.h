@@ -0,0 +1,76 @@
+/******************************************************************************
+ * file: ThreadPlacement.h
+ *
+ * description: Policy for which CPUs the game thread and the network threads
+ *              run on. Each role gets a CPU list from the settings file:
+ *
+ *                server.cpus.game   = 0
+ *                server.cpus.accept = 1
+ *                server.cpus.recv   = 2-5
+ *                server.cpus.send   = 6
+ *
+ *              A role without a list isn't pinned at all. Recv-threads get one
+ *              CPU each from their list (round-robin), the other roles are
+ *              pinned to their whole list. A thread places itself as it starts,
+ *              before it allocates anything, so the memory it first touches
+ *              (like the buffers of a recv-thread) ends up on its own NUMA node.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+#include "config.h"
+
+#include <atomic>       // std::atomic<T>
+#include <vector>       // std::vector<T>
+
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+    #include <sched.h>  // cpu_set_t, CPU_SET()
+#endif
+
+
+class ThreadPlacement {
+  public:
+    enum Role {Game = 0, Accept, Recv, Send, NumRoles};
+
+    static ThreadPlacement& instance(void);
+
+    bool place(Role role, const char* name);    // Pins the calling thread according to its role's policy.
+    void LogLayout(void);
+
+  private:
+    ThreadPlacement(void);
+    ThreadPlacement(const ThreadPlacement&);
+    ThreadPlacement& operator=(const ThreadPlacement&);
+
+    void load_topology(void);
+
+    static const char* role_name(Role role);
+    static const char* role_key(Role role);
+
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        static bool parse_cpus(const char* list, cpu_set_t* set);
+        static void format_cpus(const cpu_set_t* set, char* buf, std::size_t size);
+
+        struct Policy {
+            cpu_set_t cpus;
+            std::vector<int> order;         // The CPUs of the set, in the order recv-threads are given them.
+            std::atomic<unsigned int> next; // Next CPU (index into order) to give a recv-thread.
+        };
+
+        Policy policy[NumRoles];
+        std::vector<int> cpu_node;          // NUMA node of each CPU, -1 if unknown.
+        int nodes;
+    #endif
+};
+
+
+inline ThreadPlacement& ThreadPlacement::instance(void) {
+    static ThreadPlacement instanceOfThreadPlacement;
+    return instanceOfThreadPlacement;
+}
+
+
+#endif // THREADPLACEMENT_H
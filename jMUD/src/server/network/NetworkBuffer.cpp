@@ -0,0 +1,198 @@
+/******************************************************************************
+ * file: NetworkBuffer.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkBuffer.h"
+
+#include <cstdlib>      // malloc(), free()
+#include <cstring>      // memcpy()
+#include <new>          // std::bad_alloc, placement new
+
+
+namespace net {
+
+
+BufferPool::BufferPool(void) :
+    free_list(),
+    free_count(),
+    staging_buffer(NULL),
+    returned(NULL),
+    n_alloc(0),
+    n_hit(0),
+    n_returned(0)
+{
+    static_assert(sizeof(Header) == 16, "BufferPool::Header has to be 16 bytes to keep the data aligned.");
+}
+
+
+/***
+ * Frees all buffers currently held by the pool. Buffers still handed out
+ * must not be released after this, so the pool has to outlive its users.
+ */
+BufferPool::~BufferPool(void) {
+    reclaim();
+    for (std::size_t i = 0; i < NumSizeClasses; i++) {
+        while (free_list[i] != NULL) {
+            Header* h = free_list[i];
+            free_list[i] = next(h);
+            free(h);
+        }
+    }
+    if (staging_buffer != NULL)
+        free(header(staging_buffer));
+}
+
+
+/***
+ * Returns a buffer of at least size bytes. Served from the free list of the
+ * matching size class if possible, else from the system allocator.
+ */
+char* BufferPool::allocate(std::size_t size) {
+    std::size_t sclass = size_class(size);
+    if (sclass == NumSizeClasses)
+        return allocate_unpooled(size);
+
+    ++n_alloc;
+    if (free_list[sclass] == NULL)
+        reclaim();
+
+    Header* h = free_list[sclass];
+    if (h != NULL) {
+        free_list[sclass] = next(h);
+        --free_count[sclass];
+        ++n_hit;
+    } else {
+        h = static_cast<Header*>(malloc(sizeof(Header) + class_size(sclass)));
+        if (h == NULL)
+            throw std::bad_alloc();
+    }
+
+    h->owner = this;
+    h->sclass = static_cast<uint32_t>(sclass);
+    return payload(h);
+}
+
+
+/***
+ * Returns a pooled buffer holding a copy of the length bytes at data, sized
+ * for them rather than the read they came from, so a 3 byte keystroke doesn't
+ * pin 64 KiB. The staging buffer stays with the pool for the next read.
+ */
+char* BufferPool::claim(const char* data, std::size_t length) {
+    assert(data != NULL);
+    assert(length > 0 && length <= StagingSize);
+
+    char* buffer = allocate(length);
+    memcpy(buffer, data, length);
+    return buffer;
+}
+
+
+char* BufferPool::staging(void) {
+    if (staging_buffer == NULL)
+        staging_buffer = allocate(StagingSize);
+    return staging_buffer;
+}
+
+
+/***
+ * Hands a buffer back to the pool it came from. Safe to call from any thread,
+ * the buffer is pushed onto the owning pool's return stack and picked up by
+ * the owner the next time it runs out of buffers.
+ */
+void BufferPool::release(char* data) {
+    if (data == NULL)
+        return;
+
+    Header* h = header(data);
+    BufferPool* pool = h->owner;
+    if (pool == NULL) {
+        if (h->sclass == SharedClass && h->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        free(h);
+        return;
+    }
+
+    Header* head = pool->returned.load(std::memory_order_relaxed);
+    do {
+        next(h) = head;
+    } while (!pool->returned.compare_exchange_weak(head, h, std::memory_order_release, std::memory_order_relaxed));
+    pool->n_returned.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/***
+ * Allocates a buffer that isn't owned by any pool, for threads that don't
+ * have one. It can still be released with BufferPool::release().
+ */
+char* BufferPool::allocate_unpooled(std::size_t size) {
+    Header* h = static_cast<Header*>(malloc(sizeof(Header) + size));
+    if (h == NULL)
+        throw std::bad_alloc();
+    h->owner = NULL;
+    h->sclass = NumSizeClasses;
+    return payload(h);
+}
+
+
+/***
+ * Allocates an unpooled buffer that is only freed once it has been released
+ * refs times, by any threads. Meant for data queued for several connections,
+ * each message holding it releases it once it has been sent. The data must
+ * not be changed once handed out.
+ */
+char* BufferPool::allocate_shared(std::size_t size, uint32_t refs) {
+    assert(refs > 0);
+
+    Header* h = static_cast<Header*>(malloc(sizeof(Header) + size));
+    if (h == NULL)
+        throw std::bad_alloc();
+    h->owner = NULL;
+    h->sclass = SharedClass;
+    new (&h->refs) std::atomic<uint32_t>(refs);
+    return payload(h);
+}
+
+
+/***
+ * Takes every buffer on the return stack and sorts them onto the free lists.
+ * NOTE: Taking the whole stack with a single exchange() means we never pop
+ *       individual nodes, so there is no ABA problem to worry about.
+ */
+void BufferPool::reclaim(void) {
+    Header* h = returned.exchange(NULL, std::memory_order_acquire);
+    while (h != NULL) {
+        Header* following = next(h);
+        put(h);
+        h = following;
+    }
+}
+
+
+void BufferPool::put(Header* h) {
+    std::size_t sclass = static_cast<std::size_t>(h->sclass);
+    std::size_t limit = MaxFreeBytesPerClass / class_size(sclass);
+    if (limit < MinFreePerClass)
+        limit = MinFreePerClass;
+
+    if (free_count[sclass] >= limit) {
+        free(h);
+        return;
+    }
+    next(h) = free_list[sclass];
+    free_list[sclass] = h;
+    ++free_count[sclass];
+}
+
+
+void BufferPool::LogStatus(const char* name) {
+    sys::log::NetworkEngine::debug("<%s> buffers: %lu allocations, %lu hits, %lu misses, %lu returned",
+            name, n_alloc, n_hit, n_alloc - n_hit, GetReturned());
+}
+
+
+} // namespace net
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * file: NetworkBuffer.h
+ *
+ * description: Size-classed buffer pool for data passed between the network
+ *              threads and the game. Each pool is owned by one thread, which
+ *              is the only one allocating from it, while any thread may hand
+ *              buffers back. Returned buffers are pushed onto a lock-free
+ *              stack which the owner reclaims in one go when it runs dry.
+ *
+ *              Shared buffers are unpooled and reference counted, so the same
+ *              data (a broadcast) can be queued for many connections at once.
+ *              Each holder releases it once, the last one frees it.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKBUFFER_H
+#define NETWORKBUFFER_H
+
+#include "config.h"
+
+#include <atomic>       // std::atomic<T>
+#include <cassert>      // assert()
+
+
+namespace net {
+
+
+class BufferPool {
+public:
+    // Size classes are 64, 256, 1 KiB, 4 KiB, 16 KiB and 64 KiB. The largest class is also the size of the
+    // staging buffer, so any single read fits in one pooled buffer.
+    static const std::size_t NumSizeClasses = 6;
+    static const std::size_t MinClassSize = 64;
+    static const std::size_t MaxClassSize = MinClassSize << (2 * (NumSizeClasses - 1));
+    static const std::size_t StagingSize = MaxClassSize;
+
+    // Limit how much memory each size class may keep on its free list, anything above is given back to the
+    // system allocator.
+    static const std::size_t MaxFreeBytesPerClass = 1024 * 1024;
+    static const std::size_t MinFreePerClass = 16;
+
+    BufferPool(void);
+    ~BufferPool(void);
+
+    // Owner thread only.
+    char*  allocate(std::size_t size);
+    char*  claim(const char* data, std::size_t length);     // Buffer holding a copy of the data read.
+    char*  staging(void);                                   // Buffer to read into, StagingSize bytes large.
+
+    // Any thread.
+    static void  release(char* data);
+    static char* allocate_unpooled(std::size_t size);
+    static char* allocate_shared(std::size_t size, uint32_t refs);  // Freed by the refs'th release().
+
+    uint64_t GetAllocations(void) {return n_alloc;}
+    uint64_t GetHits(void)        {return n_hit;}
+    uint64_t GetMisses(void)      {return n_alloc - n_hit;}
+    uint64_t GetReturned(void)    {return n_returned.load(std::memory_order_relaxed);}
+
+    void LogStatus(const char* name);
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    // Placed in front of every buffer. Kept at 16 bytes so the data stays 16-byte aligned.
+    struct Header {
+        BufferPool*           owner;    // NULL for unpooled buffers.
+        uint32_t              sclass;   // NumSizeClasses for unpooled, SharedClass for shared buffers.
+        std::atomic<uint32_t> refs;     // Shared buffers only, releases left before it's freed.
+    };
+    static const uint32_t SharedClass = NumSizeClasses + 1;
+
+    static std::size_t size_class(std::size_t size);
+    static std::size_t class_size(std::size_t sclass) {return MinClassSize << (2 * sclass);}
+    static Header*     header(const char* data) {return reinterpret_cast<Header*>(const_cast<char*>(data)) - 1;}
+    static char*       payload(Header* h) {return reinterpret_cast<char*>(h + 1);}
+    // While on a free list or the return stack the payload is unused and holds the link to the next buffer.
+    static Header*&    next(Header* h) {return *reinterpret_cast<Header**>(payload(h));}
+
+    void  reclaim(void);
+    void  put(Header* h);
+
+    Header*     free_list[NumSizeClasses];
+    std::size_t free_count[NumSizeClasses];
+    char*       staging_buffer;
+
+    std::atomic<Header*> returned;      // Lock-free stack of buffers released by other threads.
+
+    uint64_t n_alloc;
+    uint64_t n_hit;
+    std::atomic<uint64_t> n_returned;
+};
+
+
+/***
+ * Returns the smallest size class that can hold size bytes, or NumSizeClasses
+ * if it's larger than the largest class.
+ */
+inline std::size_t BufferPool::size_class(std::size_t size) {
+    std::size_t sclass = 0;
+    while (sclass < NumSizeClasses && class_size(sclass) < size) {
+        ++sclass;
+    }
+    return sclass;
+}
+
+
+} // namespace net
+
+#endif // NETWORKBUFFER_H
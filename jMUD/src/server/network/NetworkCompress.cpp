@@ -0,0 +1,76 @@
+/******************************************************************************
+ * file: NetworkCompress.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkCompress.h"
+
+#include <cstring>      // memset()
+
+
+namespace net {
+
+
+DeflatePool::DeflatePool(int l, int w, int m, std::size_t n) :
+    level(l),
+    windowBits(w),
+    memLevel(m),
+    maxFree(n),
+    free_streams(),
+    in_use(0)
+{
+    free_streams.reserve(maxFree);
+}
+
+
+DeflatePool::~DeflatePool() {
+    for (z_stream* z: free_streams) {
+        deflateEnd(z);
+        delete z;
+    }
+}
+
+
+z_stream* DeflatePool::acquire(void) {
+    z_stream* z;
+    if (!free_streams.empty()) {
+        z = free_streams.back();
+        free_streams.pop_back();
+    } else {
+        z = new z_stream;
+        memset(z, 0, sizeof(*z));
+        z->zalloc = Z_NULL;
+        z->zfree = Z_NULL;
+        z->opaque = Z_NULL;
+
+        int e = deflateInit2(z, level, Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY);
+        if (e != Z_OK) {
+            sys::log::NetworkEngine::error("DeflatePool: deflateInit2() - FAILED (%i:%s)", e, (z->msg != NULL) ? z->msg : "");
+            delete z;
+            return NULL;
+        }
+    }
+
+    ++in_use;
+    return z;
+}
+
+
+void DeflatePool::release(z_stream* z) {
+    if (z == NULL)
+        return;
+    --in_use;
+
+    if (free_streams.size() < maxFree && deflateReset(z) == Z_OK) {
+        free_streams.push_back(z);
+        return;
+    }
+    deflateEnd(z);
+    delete z;
+}
+
+
+} // namespace net
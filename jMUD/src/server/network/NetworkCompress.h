@@ -0,0 +1,52 @@
+/******************************************************************************
+ * file: NetworkCompress.h
+ *
+ * description: Pool of zlib deflate streams for MCCP2 (Telnet option 86)
+ *              compressed output. Setting up a stream allocates its window and
+ *              hash tables, so streams of closed connections are reset and
+ *              kept for the next connection instead of being freed. Only used
+ *              by the send-thread, so no locking.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKCOMPRESS_H
+#define NETWORKCOMPRESS_H
+
+#include "config.h"
+
+#include <vector>       // std::vector
+#include <zlib.h>       // z_stream, deflate()
+
+
+namespace net {
+
+
+class DeflatePool {
+public:
+    DeflatePool(int level, int windowBits, int memLevel, std::size_t maxFree);
+    ~DeflatePool();
+
+    z_stream* acquire(void);            // A stream ready to start compressing, or NULL.
+    void      release(z_stream* z);     // Resets the stream and keeps it, unless we already keep enough.
+
+    std::size_t InUse(void) {return in_use;}
+    std::size_t Free(void) {return free_streams.size();}
+
+private:
+    DeflatePool(const DeflatePool&);
+    DeflatePool& operator=(const DeflatePool&);
+
+    int level;
+    int windowBits;
+    int memLevel;
+    std::size_t maxFree;
+
+    std::vector<z_stream*> free_streams;
+    std::size_t in_use;
+};
+
+
+} // namespace net
+
+#endif // NETWORKCOMPRESS_H
@@ -9,8 +9,10 @@
 
 #define NETWORK_POLLING_USE_SELECT      1
 #define NETWORK_POLLING_USE_EPOLL       2
+#define NETWORK_POLLING_USE_IO_URING    3
 
 //#define NETWORK_POLLING NETWORK_POLLING_USE_SELECT
+//#define NETWORK_POLLING NETWORK_POLLING_USE_IO_URING
 
 // Define epoll() or select() usage, unless it has already been done.
 #ifndef NETWORK_POLLING
@@ -36,6 +38,16 @@
     #else
         #error NetworkEngine: Defined epoll usage for a non-epoll capable system.
     #endif
+#elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+    // NOTE: io_uring has to be selected explicitly (DEFINES += NETWORK_POLLING=3), since it requires a
+    //       kernel with multishot recv and provided buffer rings (6.0+).
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        #include <poll.h>
+        #include <sys/epoll.h>      // Still used by the send-thread to wait for writable sockets.
+        #include <linux/io_uring.h>
+    #else
+        #error NetworkEngine: Defined io_uring usage for a non-io_uring capable system.
+    #endif
 #else
     #error NetworkEngine: Undefined network polling method defined.
 #endif
@@ -71,6 +83,12 @@
 #include <stack>    // std::stack<T>
 #include <mutex>    // std::mutex
 
+#include "NetworkBuffer.h"
+#include "NetworkMessagePool.h"
+#include "NetworkTelnet.h"
+#include "NetworkCompress.h"
+#include "NetworkRateLimit.h"
+
 
 namespace net {
 
@@ -97,7 +115,7 @@ class NetworkEngineRecv;
 class NetworkEngineSend;
 
 //namespace Network {
-    enum MessageTypes {NewConnection, Disconnection, DataIncoming, DataOutgoing, DNSLookup};
+    enum MessageTypes {NewConnection, Disconnection, DataIncoming, DataOutgoing, DNSLookup, CompressStart, CloseConnection};
 //}
 typedef enum net::MessageTypes MessageType;
 
@@ -110,28 +128,39 @@ const ConnectionID InvalidConnectionID = 0;
 // cid = A run-time unique ID for a connection.
 // status = The status of the connection from the senders point of view.
 // size = The size of the data transfered by the message.
-// data = A pointer to the data buffer.
+// data = A pointer to the data buffer. Outgoing data may be shared by several messages (a broadcast), so it
+//        is never written to once queued, and destruct() only frees it with the last of them.
 class NetworkMessage {
 
 public:
     NetworkMessage(ConnectionID c, net::MessageType t, std::size_t s = 0, char* d = NULL);
 
-// FIXME: Handle NetworkMessage object construct/destruct with a pool allocator.
+    // NOTE: Objects are allocated from MessagePool, always use construct()/destruct().
     static NetworkMessage* construct(void);
     static NetworkMessage* construct(ConnectionID c, net::MessageType t, std::size_t s = 0, char* d = NULL);
     static void            destruct(NetworkMessage* sd);
     ConnectionID cid;
     net::MessageType type;
-    std::chrono::steady_clock::time_point received_at;
+    std::chrono::steady_clock::time_point received_at;  // DataIncoming: when the kernel got it, else construction.
     std::size_t size;
     char*  data;
+    NetworkMessage* next;   // Link while queued for output on a connection.
 
 private:
+    friend class MessagePool;
+
     NetworkMessage(void);
+
+    MessagePool::Cache* pool_owner;     // The cache this message is returned to.
+    NetworkMessage*     pool_next;      // Link while on a free list or return stack.
 };
 
 inline NetworkMessage::NetworkMessage(ConnectionID c, net::MessageType t, std::size_t s, char* d) :
-    cid(c), type(t), received_at(std::chrono::steady_clock::now()), size(s), data(d) {
+    cid(c), type(t), received_at(std::chrono::steady_clock::now()), size(s), data(d), next(NULL), pool_owner(NULL), pool_next(NULL) {
+}
+
+inline NetworkMessage::NetworkMessage(void) :
+    cid(InvalidConnectionID), type(net::MessageTypes::DataIncoming), received_at(), size(0), data(NULL), next(NULL), pool_owner(NULL), pool_next(NULL) {
 }
 //enum NetworkMessageTypes {NewConnection, Disconnection, DataIncoming, DataOutgoing, DNSLookup};
 
@@ -157,14 +186,30 @@ inline NetworkMessage* NetworkMessage::construct(ConnectionID c, net::MessageTyp
             assert(s > 0);
             assert(d != NULL);
             break;
+        case net::MessageTypes::CompressStart:
+            assert(s > 0);
+            assert(d != NULL);
+            break;
+        case net::MessageTypes::CloseConnection:
+            assert(s == 0);
+            assert(d == NULL);
+            break;
         }
     #endif
-    return new NetworkMessage(c, t, s, d);
+    NetworkMessage* m = MessagePool::allocate();
+    m->cid = c;
+    m->type = t;
+    m->received_at = std::chrono::steady_clock::now();
+    m->size = s;
+    m->data = d;
+    m->next = NULL;
+    return m;
 }
 
 inline void NetworkMessage::destruct(NetworkMessage* m) {
-    delete[] m->data;
-    delete m;
+    BufferPool::release(m->data);
+    m->data = NULL;
+    MessagePool::release(m);
 }
 
 
@@ -176,30 +221,52 @@ class SocketData {
 public:
     SocketData(ConnectionID c, SOCKET sock);
 
-    // FIXME: Handle SocketData object construct/destruct with a pool allocator.
-    static SocketData* construct(ConnectionID c, SOCKET sock);
+    // NOTE: Objects live in SocketTable, which also assigns the cid. Always use construct()/destruct().
+    static SocketData* construct(SOCKET sock);
     static void        destruct(SocketData* sd);
 
     ConnectionID cid;
     SOCKET s;
     uint64_t rx;
     uint64_t tx;
+
+    // Input, only ever touched by the recv-thread owning the connection.
+    std::size_t     slot;           // Index in the recv-thread's list of sockets.
+    TelnetDecoder   telnet;
+    char*           rx_line;        // Start of a line still waiting for the rest of it, or NULL.
+    std::size_t     rx_line_length;
+    bool            rx_overflow;    // Dropping the rest of a line that got too long.
+    bool            rx_mccp;        // The client has agreed to MCCP2.
+    bool            rx_pending;     // Edge-triggered: not drained yet, the budget ran out.
+    bool            rx_migrating;   // io_uring: recv cancelled, hand over to another thread once completed.
+    bool            rx_paused;      // Not read from until rx_resume_at, the input limits ran dry.
+    std::chrono::steady_clock::time_point rx_resume_at;
+    TokenBucket     rx_byte_limit;  // Input limits, see NetworkEngine::InputBytesPerSecond and
+    TokenBucket     rx_line_limit;  // InputLinesPerSecond.
+
+    // Output, only ever touched by the send-thread.
+    NetworkMessage* out_head;       // Queue of DataOutgoing messages not yet (fully) sent.
+    NetworkMessage* out_tail;
+    std::size_t     out_offset;     // Bytes of out_head already sent.
+    std::size_t     out_queued;     // Bytes queued and not yet sent.
+    bool            out_blocked;    // The socket buffer is full, waiting for it to become writable.
+    bool            out_watched;    // Registered with the send-thread's poll set.
+    z_stream*       out_zstream;    // MCCP2: deflates all output from here on, or NULL.
+    NetworkMessage* out_zchunk;     // MCCP2: the message (last in the queue) deflate() is writing into.
+    std::size_t     out_zroom;      // Bytes left in out_zchunk.
+    bool            out_zpending;   // MCCP2: deflate() has been given output since the last flush.
+    bool            out_close;      // Closed by the game (shut down once the queue is empty), or output dropped.
 };
 
-inline SocketData::SocketData(ConnectionID c, SOCKET sock) : cid(c), s(sock), rx(0), tx(0) {
+inline SocketData::SocketData(ConnectionID c, SOCKET sock) :
+    cid(c), s(sock), rx(0), tx(0), slot(0), telnet(), rx_line(NULL), rx_line_length(0), rx_overflow(false), rx_mccp(false),
+    rx_pending(false), rx_migrating(false), rx_paused(false), rx_resume_at(), rx_byte_limit(0, 0), rx_line_limit(0, 0),
+    out_head(NULL), out_tail(NULL), out_offset(0), out_queued(0), out_blocked(false), out_watched(false),
+    out_zstream(NULL), out_zchunk(NULL), out_zroom(0), out_zpending(false), out_close(false) {
     assert(c != InvalidConnectionID);
     assert(s != INVALID_SOCKET);
 }
 
-inline SocketData* SocketData::construct(ConnectionID c, SOCKET sock) {
-    assert(c != InvalidConnectionID);
-    assert(sock != INVALID_SOCKET);
-    return new SocketData(c, sock);
-}
-inline void SocketData::destruct(SocketData* sd) {
-    delete sd;
-}
-
 
 } // namespace net
 
@@ -213,10 +280,10 @@ class MemoryLocationSortedArrayMT {
 };
 
 
-#include "UnorderedQueueMT.h"
+#include "QueueMPSC.h"
 
-typedef UnorderedQueueMT<net::SocketData*> SocketQueue;
-typedef UnorderedQueueMT<net::NetworkMessage*> NetworkQueue;
+typedef QueueMPSC<net::SocketData*, 4096> SocketQueue;
+typedef QueueMPSC<net::NetworkMessage*, 16384> NetworkQueue;
 
 
 #endif // NETWORKCORE_H
@@ -104,6 +104,7 @@
 #include "NetworkEngineAccept.h"
 #include "NetworkEngineSend.h"
 #include "NetworkEngineRecv.h"
+#include "NetworkUring.h"
 #include "UnorderedArray.h"
 #include "../GameEngine.h"
 
@@ -113,6 +114,7 @@
     #include <fcntl.h>          // fcntl()
     #include <netdb.h>          // getnameinfo(), NI_MAXHOST
     #include <netinet/tcp.h>    // TCP_NODELAY
+    #include <sys/uio.h>        // writev(), struct iovec
 
 //    #include <sys/types.h>
 //    #include <sys/stat.h>
@@ -122,37 +124,38 @@
 #endif
 
 #include <cassert>
+#include <chrono>       // std::chrono::steady_clock
+#include <cstring>      // memcpy(), memset(), strlen()
 
 
 namespace net {
 
 
-uint64_t NetworkEngine::rx_bytes;
-uint64_t NetworkEngine::tx_bytes;
-uint64_t NetworkEngine::nsocket_recv;
-uint64_t NetworkEngine::nsocket_send;
-uint32_t NetworkEngine::nsocket_accept;
-
-
 /***
  * Constructor for the communications class. Initializes all pointers to NULL,
  * and tries to allocate memory for those that should be done for.
  */
 NetworkEngine::NetworkEngine(void):
     threads(0),
+    accept_threads(),
+    recv_threads(),
+    recv_balance_next(0),
+    send_thread(NULL),
     mutex_threads(),
     server_hostname(NULL),
     server_port(4000),
     _shutdown(false),
     _terminate(false),
-    nextCID(1),
+    _draining(false),
+    _drained(false),
     users_total(0),
     users_current(0),
     users_peak(0),
     _MaxConnectionsTotal(256),
-    uqueue_new(),
     uqueue_remove(),
     messagesToSend(),
+    tick_output(),
+    resolver(),
     threads_accept(0),
     threads_recv(0),
     threads_send(0)
@@ -232,10 +235,16 @@ bool NetworkEngine::initialize(int maxConnections = 256, IPPort port = 4000, con
         }
     #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
         _MaxConnectionsTotal = max_sys - 32;
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        if (NetworkUring::is_supported() == false) {
+            sys::log::NetworkEngine::error("io_uring based polling selected, but the kernel lacks support for it. Aborting.");
+            return false;
+        }
+        _MaxConnectionsTotal = max_sys - 32;
     #endif
 
     users_total = users_current = users_peak = 0;
-    sys::log::NetworkEngine::add("max connections = %i", _MaxConnectionsTotal);
+    sys::log::NetworkEngine::add("max connections = %lu", _MaxConnectionsTotal.load());
 
 
     sys::log::NetworkEngine::debug("Logging host network related information.");
@@ -251,8 +260,20 @@ bool NetworkEngine::initialize(int maxConnections = 256, IPPort port = 4000, con
 
 
     sys::log::NetworkEngine::debug("Spawning server accept-threads...");
-    SpawnAcceptThread("IPv4", ipv4, server_port, AF_INET);
-    SpawnAcceptThread("IPv6", ipv6, server_port, AF_INET6);
+    if (use_reuseport) {
+        // NOTE: The accept-threads for an address each have their own listener bound to it, and the
+        //       kernel spreads the new connections between them.
+        char name[16];
+        for (unsigned int i = 1; i <= AcceptThreadsPerAddress; i++) {
+            snprintf(name, sizeof(name), "IPv4.%u", i);
+            SpawnAcceptThread(name, ipv4, server_port, AF_INET);
+            snprintf(name, sizeof(name), "IPv6.%u", i);
+            SpawnAcceptThread(name, ipv6, server_port, AF_INET6);
+        }
+    } else {
+        SpawnAcceptThread("IPv4", ipv4, server_port, AF_INET);
+        SpawnAcceptThread("IPv6", ipv6, server_port, AF_INET6);
+    }
     sys::log::NetworkEngine::debug("  %3i accept-threads spawned", threads_accept);
     if (threads_accept == 0) {
         sys::log::NetworkEngine::error("Failed to start any accept-threads. Aborting.");
@@ -261,7 +282,9 @@ bool NetworkEngine::initialize(int maxConnections = 256, IPPort port = 4000, con
     }
 
     sys::log::NetworkEngine::debug("Spawning server recv-threads...");
+    mutex_threads.lock();
     SpawnRecvThread("Recv1");
+    mutex_threads.unlock();
     sys::log::NetworkEngine::debug("  %3i recv-threads spawned", threads_recv);
     if (threads_recv == 0) {
         sys::log::NetworkEngine::error("Failed to start any recv-threads. Aborting.");
@@ -269,6 +292,12 @@ bool NetworkEngine::initialize(int maxConnections = 256, IPPort port = 4000, con
         return false;
     }
 
+    if (use_dns_lookup) {
+        sys::log::NetworkEngine::debug("Spawning resolver-threads...");
+        if (resolver.start(ResolverThreads) == false)
+            sys::log::NetworkEngine::warning("Failed to start any resolver-threads, host names will not be looked up.");
+    }
+
     sys::log::NetworkEngine::debug("Spawning server cleanup-threads...");
     SpawnSendThread("Send1");
     sys::log::NetworkEngine::debug("  %3i send-threads spawned", threads_send);
@@ -284,38 +313,84 @@ bool NetworkEngine::initialize(int maxConnections = 256, IPPort port = 4000, con
 
 
 /***
- * Closes the communications system, and deallocates the memory allocated for
- * the datastructures used in the NetworkEngine class.
+ * Closes the communications system. First no more connections are accepted
+ * and no more input is read, then the message (if any) is sent to every
+ * connection and the send-thread flushes all output left, before it closes
+ * the connections. The flush ends as soon as everything is written, so how
+ * long it takes depends on the clients too slow to take their output right
+ * away, but it never takes more than ShutdownFlushTimeout ms.
  */
-bool NetworkEngine::close(void) {
+bool NetworkEngine::close(const char* message) {
+    if (_shutdown.exchange(true, std::memory_order_acq_rel))
+        return true;
+
     // NOTE: This will signal all threads to terminate, except for the NetworkEngineSend threads which we
     //       want to stay running to properly close down all connections.
-    _shutdown = true;
+    mutex_threads.lock();
+    for (NetworkEngineThread* t: threads) {
+        t->wakeup();
+    }
+    std::vector<NetworkEngineAccept*> accept(accept_threads);
+    std::vector<NetworkEngineRecv*> recv(recv_threads);
+    mutex_threads.unlock();
 
-    // TODO: Add proper mechanisms to allow for interrupting the select wait in the accept threads so we
-    //       can wait for them to exit properly before closing down NetworkEngine properly.
-    //         Create a pipe(2) to each thread, this could possibly be used for passing command messages
-    //       in the future.
+    // NOTE: The accept-threads go first, so no new connection is handed to a recv-thread after it is gone.
+    //       Only those waiting in epoll can be woken up, one blocking in accept() stays there until the
+    //       next connection arrives, which AddNewConnection() then turns away.
+    if (use_reuseport) {
+        for (NetworkEngineAccept* t: accept) {
+            t->join();
+        }
+    }
 
-    // Wait for all threads to terminate.
-//    for (SocketThread* t: threads) {
-        // TOOD: Uncomment when all SocketThread classes have been made to terminate properly.
-        // t->join();
-//    }
+    // NOTE: Once the recv-threads are gone nothing more is read, and nothing but the send-thread touches
+    //       the connections.
+    for (NetworkEngineRecv* t: recv) {
+        t->join();
+    }
+    resolver.stop();
+
+    if (send_thread.load(std::memory_order_acquire) != NULL) {
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+        // NOTE: Each connection is shut down as soon as all its output is written, its client isn't kept
+        //       waiting for the slowest one.
+        std::vector<ConnectionID> cids;
+        SocketTable::instance().connections(cids);
+        if (message != NULL && !cids.empty())
+            BroadcastTickData(cids.data(), cids.size(), message, strlen(message));
+        for (ConnectionID cid: cids) {
+            CloseConnection(cid);
+        }
+        FlushTickOutput();
+        _draining.store(true, std::memory_order_release);
+        WakeupSendThread();
+
+        int timeout = ShutdownFlushTimeout;
+        std::chrono::steady_clock::time_point deadline = started + std::chrono::milliseconds(timeout);
+        while (!_drained.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
 
-    //
-    sleep(2);
+        long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+        if (_drained.load(std::memory_order_acquire))
+            sys::log::NetworkEngine::add("Shutdown: output to %lu connection(s) flushed in %li ms.", cids.size(), elapsed);
+        else
+            sys::log::NetworkEngine::warning("Shutdown: output to %lu connection(s) not flushed after %li ms, closing them anyway.", cids.size(), elapsed);
+    }
 
-    // NOTE: This will signal all NetworkEngineSend threads to terminate.
-    _terminate = true;
+    // NOTE: This will signal the NetworkEngineSend thread to close the connections and terminate.
+    _terminate.store(true, std::memory_order_release);
+    WakeupSendThread();
+    NetworkEngineThread* send = send_thread.load(std::memory_order_acquire);
+    if (send != NULL)
+        send->join();
 
     #if (PLATFORM == PLATFORM_WINDOWS)
         // NOTE: Windows wants us to report when we don't need sockets anymore.
         WSACleanup();
     #endif // (PLATFORM == PLATFORM_WINDOWS)
 
-    sleep(4);
-
     LogStatus();
     return true;
 }
@@ -338,32 +413,34 @@ void NetworkEngine::SpawnAcceptThread(const char* name, const char* addr, IPPort
     mutex_threads.lock();
     ++threads_accept;
     threads.push_back(t);
+    accept_threads.push_back(t);
     mutex_threads.unlock();
 
     sys::log::NetworkEngine::add("Spawned accept-thread <%s> (IP=%s, port=%hu)", name, addr, port);
 }
 
 
-void NetworkEngine::SpawnRecvThread(const char* name) {
+// NOTE: mutex_threads has to be held.
+NetworkEngineRecv* NetworkEngine::SpawnRecvThread(const char* name) {
     NetworkEngineRecv* t = new NetworkEngineRecv(name);
     if (t == NULL) {
         sys::log::NetworkEngine::error("Failed to spawn recv-thread '%s'.", name);
-        return;
+        return NULL;
     }
 
     if (t->run() == false) {
         delete t;
         sys::log::NetworkEngine::error("Failed to run recv-thread '%s'.", name);
-        return;
+        return NULL;
     }
 
-    mutex_threads.lock();
     ++threads_recv;
     threads.push_back(t);
-    mutex_threads.unlock();
+    recv_threads.push_back(t);
 
     sys::log::NetworkEngine::add("Spawned recv-thread <%s>", name);
- }
+    return t;
+}
 
 
 void NetworkEngine::SpawnSendThread(const char* name) {
@@ -382,13 +459,14 @@ void NetworkEngine::SpawnSendThread(const char* name) {
     mutex_threads.lock();
     ++threads_send;
     threads.push_back(t);
+    send_thread = t;
     mutex_threads.unlock();
 
     sys::log::NetworkEngine::add("Spawned send-thread <%s>", name);
  }
 
 
-SOCKET NetworkEngine::setup_server_socket(int type, const char* host, IPPort port) {
+SOCKET NetworkEngine::setup_server_socket(int type, const char* host, IPPort port, bool reuseport) {
     assert(((type == AF_INET) || (type == AF_INET6)));
     assert(port != 0);
 
@@ -412,6 +490,20 @@ SOCKET NetworkEngine::setup_server_socket(int type, const char* host, IPPort por
         sys::log::NetworkEngine::warning("Unable to properly set options on server socket.");
     }
 
+    // NOTE: Accepted sockets inherit the listener's options (non-blocking through accept4() though), so
+    //       we set them here once instead of on every new connection.
+    if (reuseport) {
+        if (socket_mode_reuseport(server) == false) {
+            sys::log::NetworkEngine::fatal("Unable to share the address of the server socket. Aborting.");
+            socket_close(server);
+            return INVALID_SOCKET;
+        }
+        if (socket_mode_nonblocking(server) == false || socket_mode_keepalive(server) == false || socket_mode_timestamp(server) == false ||
+            socket_mode_nodelay(server) == false) {
+            sys::log::NetworkEngine::warning("Unable to properly set options on server socket.");
+        }
+    }
+
     if (socket_bind(server, type, host, port) == false) {
         sys::log::NetworkEngine::fatal("Unable to bind server socket. Aborting.");
         socket_close(server);
@@ -433,33 +525,53 @@ SOCKET NetworkEngine::setup_server_socket(int type, const char* host, IPPort por
 /***
  * Updates internal data for the new connection.
  */
-void NetworkEngine::AddNewConnection(SOCKET s) {
+void NetworkEngine::AddNewConnection(SOCKET s, const struct sockaddr_storage* addr, socklen_t size) {
     assert(s != INVALID_SOCKET);
 
-    // Since nextCID can never decrease we can safely do this check before acquiring the lock.
-    if (nextCID >= MaxConnectionID) {
-        sys::log::NetworkEngine::error("Cannot assign a CID, somehow we assigned %i CIDs.", MaxConnectionID);
-        sys::log::NetworkEngine::debug("socket (%i): connected - (cid = ?) FAILED (max CID reached)", s);
+    // NOTE: Once shutting down the recv-threads may already be gone, and the connection would be missed by
+    //       the final flush.
+    if (shutdown()) {
+        sys::log::NetworkEngine::debug("socket (%i): connected - FAILED (shutting down)", s);
         socket_close(s);
         return;
     }
 
-    // Initialize the SocketData for the new connection.
-// WARNING: The commented line below this has a subtle bug that ISN'T caught by the compiler, since both
-//          SOCKET and ConnectionID are typedefs of int's (even if one is unsigned and one is signed).
-//    SocketData* sd = SocketData::construct(s, nextCID++);
-    SocketData* sd = SocketData::construct(nextCID++, s);
+    // Initialize the SocketData for the new connection, this also assigns its cid.
+    SocketData* sd = SocketData::construct(s);
+    if (sd == NULL) {
+        sys::log::NetworkEngine::debug("socket (%i): connected - (cid = ?) FAILED (no free SocketData slot)", s);
+        socket_close(s);
+        return;
+    }
+    if (use_input_limits) {
+        sd->rx_byte_limit = TokenBucket(InputBytesPerSecond, InputBytesBurst);
+        sd->rx_line_limit = TokenBucket(InputLinesPerSecond, InputLinesBurst);
+    }
     NetworkMessage* m = NetworkMessage::construct(sd->cid, net::MessageTypes::NewConnection, 0, NULL);
     GameEngine::instance().AddMessageRecv(m);
 
-    uqueue_new.lock();
-    uqueue_new.push(sd);
-
     // Update connection and statistics tracking values.
+    NetworkStats::local().accepted();
     users_total++;
-    users_current++;
-    users_peak = std::max(users_peak, users_current);
-    uqueue_new.unlock();
+    unsigned int current = ++users_current;
+    unsigned int peak = users_peak.load();
+    while (current > peak && !users_peak.compare_exchange_weak(peak, current)) {
+    }
+
+    if (AssignConnection(sd, NULL) == false) {
+        sys::log::NetworkEngine::error("socket (%i): connected (cid = %u) - FAILED (no recv-thread to take it)", s, sd->cid);
+        DisconnectConnection(sd);
+        return;
+    }
+
+    // NOTE: The game hears of the host name later, as a DNSLookup message.
+    if (use_dns_lookup && addr != NULL)
+        resolver.lookup(sd->cid, *addr, size);
+
+    if (use_mccp2) {
+        const char offer[] = {static_cast<char>(telnet::IAC), static_cast<char>(telnet::WILL), static_cast<char>(telnet::COMPRESS2)};
+        SendData(sd->cid, offer, sizeof(offer));
+    }
 
     sys::log::NetworkEngine::debug("socket (%i): connected (cid = %u)", s, sd->cid);
     LogStatus();
@@ -479,27 +591,280 @@ void NetworkEngine::DisconnectConnection(SocketData* sd) {
 
     NetworkMessage* m = NetworkMessage::construct(sd->cid, net::MessageTypes::Disconnection, 0, NULL);
     GameEngine::instance().AddMessageRecv(m);
-
-    NetworkEngine::socket_close(sd->s);
-    SocketData::destruct(sd);
     users_current--;
+
+    // NOTE: The send-thread may still have output queued for the connection, so it is the one closing the
+    //       socket and releasing the SocketData once it has dropped that output.
+    while (uqueue_remove.push(sd) == false) {
+        std::this_thread::yield();
+    }
+    WakeupSendThread();
 }
 
 
-// FIXME: Add a version that takes a list and push()es all the elements from that list.
 void NetworkEngine::QueueSendMessage(NetworkMessage* m) {
-    messagesToSend.lock();
-    messagesToSend.push(m);
-    messagesToSend.unlock();
+    QueueSendMessages(&m, 1);
+}
+
+
+/***
+ * Queues all n messages for sending. If the queue is full we wait for the
+ * send-thread to make room, rather than dropping output.
+ */
+void NetworkEngine::QueueSendMessages(NetworkMessage** m, std::size_t n) {
+    std::size_t queued = messagesToSend.push(m, n);
+    WakeupSendThread();
+    if (queued == n)
+        return;
+
+    sys::log::NetworkEngine::warning("messagesToSend is full (%lu messages), waiting for the send-thread.", messagesToSend.size());
+    while (queued < n) {
+        std::this_thread::yield();
+        queued += messagesToSend.push(m + queued, n - queued);
+    }
+    WakeupSendThread();
+}
+
+
+void NetworkEngine::WakeupSendThread(void) {
+    NetworkEngineThread* t = send_thread.load(std::memory_order_acquire);
+    if (t != NULL)
+        t->wakeup();
+}
+
+
+/***
+ * Queues a copy of the data to be sent to the connection. Output for a cid
+ * that has been disconnected is silently dropped by the send-thread.
+ */
+void NetworkEngine::SendData(ConnectionID cid, const char* data, std::size_t length) {
+    assert(cid != InvalidConnectionID);
+    assert(data != NULL);
+    assert(length > 0);
+
+    char* buffer = BufferPool::allocate_unpooled(length);
+    memcpy(buffer, data, length);
+    QueueSendMessage(NetworkMessage::construct(cid, net::MessageTypes::DataOutgoing, length, buffer));
+}
+
+
+/***
+ * Copies the data and holds it until the end of the current tick, when
+ * FlushTickOutput() queues it together with the rest of the tick's output.
+ * Only to be called by the game-thread.
+ */
+void NetworkEngine::SendTickData(ConnectionID cid, const char* data, std::size_t length) {
+    assert(cid != InvalidConnectionID);
+    assert(data != NULL);
+    assert(length > 0);
+
+    char* buffer = BufferPool::allocate_unpooled(length);
+    memcpy(buffer, data, length);
+    tick_output.push_back(NetworkMessage::construct(cid, net::MessageTypes::DataOutgoing, length, buffer));
+}
+
+
+/***
+ * Like SendTickData(), for the same data going to n connections. The data is
+ * copied once into a shared buffer that all n messages point to, and is freed
+ * when the last of them has been sent (or dropped). Only to be called by the
+ * game-thread.
+ */
+void NetworkEngine::BroadcastTickData(const ConnectionID* cids, std::size_t n, const char* data, std::size_t length) {
+    assert(cids != NULL);
+    assert(data != NULL);
+    assert(length > 0);
+    if (n == 0)
+        return;
+
+    char* buffer = BufferPool::allocate_shared(length, static_cast<uint32_t>(n));
+    memcpy(buffer, data, length);
+    tick_output.reserve(tick_output.size() + n);
+    for (std::size_t i = 0; i < n; i++) {
+        assert(cids[i] != InvalidConnectionID);
+        tick_output.push_back(NetworkMessage::construct(cids[i], net::MessageTypes::DataOutgoing, length, buffer));
+    }
+}
+
+
+/***
+ * Queues all output held during the tick in one batch, waking the send-thread
+ * once. The send-thread gathers each connection's share of it into a single
+ * write. Called by the game-thread at the end of every tick.
+ */
+void NetworkEngine::FlushTickOutput(void) {
+    if (tick_output.empty())
+        return;
+
+    QueueSendMessages(tick_output.data(), tick_output.size());
+    tick_output.clear();
+}
+
+
+/***
+ * Queues the MCCP2 start sequence (IAC SB COMPRESS2 IAC SE) for the
+ * connection. The send-thread compresses all output queued after it.
+ */
+void NetworkEngine::StartCompression(ConnectionID cid) {
+    assert(cid != InvalidConnectionID);
+
+    const char start[] = {static_cast<char>(telnet::IAC), static_cast<char>(telnet::SB), static_cast<char>(telnet::COMPRESS2),
+                          static_cast<char>(telnet::IAC), static_cast<char>(telnet::SE)};
+    char* buffer = BufferPool::allocate_unpooled(sizeof(start));
+    memcpy(buffer, start, sizeof(start));
+    QueueSendMessage(NetworkMessage::construct(cid, net::MessageTypes::CompressStart, sizeof(start), buffer));
+}
+
+
+/***
+ * Closes the connection once the output queued for it before the end of the
+ * tick has been sent. The close is held with the tick's output, so it reaches
+ * the send-thread after it, which then shuts the socket down. The recv-thread
+ * sees the connection end and disconnects it as usual, so the game still gets
+ * a Disconnection message for it. Only to be called by the game-thread.
+ */
+void NetworkEngine::CloseConnection(ConnectionID cid) {
+    assert(cid != InvalidConnectionID);
+
+    tick_output.push_back(NetworkMessage::construct(cid, net::MessageTypes::CloseConnection, 0, NULL));
+}
+
+
+/***
+ * Assigns the connection to the least loaded active recv-thread, other than
+ * exclude. If they are all above SocketsPerThreadHigh, a parked recv-thread
+ * is brought back or else a new one is spawned. Connections being migrated
+ * (exclude != NULL) never make us add recv-threads though, BalanceRecvThreads()
+ * only migrates connections when the other threads have room for them.
+ */
+bool NetworkEngine::AssignConnection(SocketData* sd, NetworkEngineRecv* exclude) {
+    NetworkEngineRecv* t = NULL;
+    bool full = false;
+    bool assigned = false;
+
+    // NOTE: All of it under mutex_threads, so accept-threads finding the recv-threads full at the same time
+    //       don't each spawn one, and t can't be retired (BalanceRecvThreads()) before sd is in its inbox.
+    mutex_threads.lock();
+    t = LeastLoadedRecvThread(exclude);
+    full = (t == NULL || t->GetLoad() >= SocketsPerThreadHigh);
+    if (full && exclude == NULL) {
+        for (NetworkEngineRecv* r: recv_threads) {
+            if (r->GetState() == NetworkEngineRecv::Parked) {
+                r->activate();
+                t = r;
+                full = false;
+                break;
+            }
+        }
+    }
+    if (full && exclude == NULL) {
+        char n[16];
+        snprintf(n, 15, "Recv%u", threads_recv + 1);
+        NetworkEngineRecv* spawned = SpawnRecvThread(n);
+        if (spawned != NULL)
+            t = spawned;
+    }
+
+    if (t != NULL && t->GetLoad() < MaxSocketsPerThread)
+        assigned = t->assign(sd);
+    mutex_threads.unlock();
+
+    if (full && exclude == NULL)
+        LogStatus();
+    return assigned;
+}
+
+
+// NOTE: mutex_threads has to be held.
+NetworkEngineRecv* NetworkEngine::LeastLoadedRecvThread(NetworkEngineRecv* exclude) {
+    NetworkEngineRecv* least = NULL;
+    for (NetworkEngineRecv* t: recv_threads) {
+        if (t == exclude || t->GetState() != NetworkEngineRecv::Active)
+            continue;
+        if (least == NULL || t->GetLoad() < least->GetLoad())
+            least = t;
+    }
+    return least;
+}
+
+
+/***
+ * Called regularly by all recv-threads, but only does anything every
+ * RecvBalanceInterval. If the other active recv-threads can take all the
+ * connections of the least loaded one and still stay below
+ * SocketsPerThreadLow, it is retired. Otherwise, if the load is too uneven,
+ * the busiest thread hands over half of the difference to the least busy.
+ */
+void NetworkEngine::BalanceRecvThreads(void) {
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = recv_balance_next.load(std::memory_order_relaxed);
+    if (now < next || !recv_balance_next.compare_exchange_strong(next, now + RecvBalanceInterval))
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_threads);
+
+    NetworkEngineRecv* least = NULL;
+    NetworkEngineRecv* most = NULL;
+    std::size_t active = 0;
+    std::size_t total = 0;
+    for (NetworkEngineRecv* t: recv_threads) {
+        if (t->GetState() != NetworkEngineRecv::Active)
+            continue;
+        ++active;
+        total += t->GetLoad();
+        if (least == NULL || t->GetLoad() < least->GetLoad())
+            least = t;
+        if (most == NULL || t->GetLoad() > most->GetLoad())
+            most = t;
+    }
+    if (active < 2)
+        return;
+
+    if (total <= (active - 1) * SocketsPerThreadLow) {
+        sys::log::NetworkEngine::add("%lu connection(s) on %lu recv-threads, retiring one", total, active);
+        least->retire();
+        return;
+    }
+
+    std::size_t difference = most->GetLoad() - least->GetLoad();
+    if (difference > RecvBalanceThreshold) {
+        sys::log::NetworkEngine::add("recv-threads unbalanced (%lu vs %lu connections), moving %lu", most->GetLoad(), least->GetLoad(), difference / 2);
+        most->shed(difference / 2);
+    }
+}
+
+
+/***
+ * Lowers the connection limit to n, if it's higher. Called by the
+ * accept-threads when the process runs out of file descriptors, the limit
+ * we started out with was evidently too high.
+ */
+void NetworkEngine::LowerMaxConnectionsTotal(std::size_t n) {
+    std::size_t current = _MaxConnectionsTotal.load();
+    while (n < current) {
+        if (_MaxConnectionsTotal.compare_exchange_weak(current, n)) {
+            sys::log::NetworkEngine::warning("max connections lowered from %lu to %lu", current, n);
+            return;
+        }
+    }
 }
 
 
 void NetworkEngine::LogStatus(void) {
-    sys::log::NetworkEngine::add("           (users = %5i, peak = %5i, total = %5i)", users_current, users_peak, users_total);
-    sys::log::NetworkEngine::add(" uqueue_new.size()    = %i", uqueue_new.size());
-    sys::log::NetworkEngine::add(" uqueue_remove.size() = %i", uqueue_remove.size());
-    sys::log::NetworkEngine::add(" RX = %lu KiB, TX = %lu KiB", rx_bytes/1024, tx_bytes/1024);
+    sys::log::NetworkEngine::add("           (users = %5u, peak = %5u, total = %5u)", users_current.load(), users_peak.load(), users_total.load());
+    sys::log::NetworkEngine::add(" uqueue_remove.size() = %lu", uqueue_remove.size());
+    sys::log::NetworkEngine::add(" messagesToSend.size() = %lu", messagesToSend.size());
+    NetworkStats::snapshot().LogStatus();
+    MessagePool::LogStatus();
+    SocketTable::instance().LogStatus();
+    if (use_dns_lookup)
+        resolver.LogStatus();
     sys::log::NetworkEngine::add(" threads: accept %u, recv %u, send %u", threads_accept, threads_recv, threads_send);
+    mutex_threads.lock();
+    for (NetworkEngineRecv* t: recv_threads) {
+        t->LogStatus();
+    }
+    mutex_threads.unlock();
 }
 
 
@@ -520,8 +885,7 @@ long NetworkEngine::socket_send(SOCKET s, const char *data, std::size_t length)
     // an assertion failure for us so we'd never even get here if that was the
     // case.
     if (result >= 0) {
-        NetworkEngine::tx_bytes += result;
-        ++NetworkEngine::nsocket_send;
+        NetworkStats::local().wrote(result);
         return result;
     }
 
@@ -549,23 +913,98 @@ long NetworkEngine::socket_send(SOCKET s, const char *data, std::size_t length)
 }
 
 
+/***
+ * Sends the count buffers in iov to the socket s with a single system call.
+ * Returns the same as socket_send(), a partial write returns the number of
+ * bytes that were actually sent.
+ */
+long NetworkEngine::socket_sendv(SOCKET s, const struct iovec* iov, int count) {
+    assert(s != INVALID_SOCKET);
+    assert(iov != NULL);
+    assert(count > 0);
+
+    #if (PLATFORM == PLATFORM_UNIX)
+        ssize_t result = writev(s, iov, count);
+        if (result >= 0) {
+            NetworkStats::local().wrote(result);
+            return result;
+        }
+    #else
+        // NOTE: No gathered write available, send the buffers one by one until one blocks.
+        long total = 0;
+        for (int i = 0; i < count; i++) {
+            long result = socket_send(s, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            if (result < 0)
+                return (total > 0) ? total : result;
+            total += result;
+            if (static_cast<std::size_t>(result) < iov[i].iov_len)
+                break;
+        }
+        return total;
+    #endif
+
+    int errorValue = get_error_code();
+
+    // NOTE: Write to socket blocked, so a transient error. Just try again next time.
+    #ifdef EAGAIN           // POSIX.1-2001 / UNIX
+    if (errorValue == EAGAIN) return 0;
+    #endif
+    #ifdef EWOULDBLOCK      // POSIX.1-2001 / BSD
+    if (errorValue == EWOULDBLOCK) return 0;
+    #endif
+    #ifdef EINTR            // POSIX
+    if (errorValue == EINTR) return 0;
+    #endif
+
+    // Fatal error. Log it and report so the socket/user can get disconnected.
+    sys::log::NetworkEngine::debug("socket (%i): error on write (%i:%s)", s, errorValue, get_error_msg(errorValue));
+    return -1;
+}
+
+
 /***
  * Reads from a socket, s, to a specified buffer. If successful the number of
  * bytes read is returned, if a temporary error occurred 0 is returned and if
  * a fatal error occurs a number < 0 is returned.
+ *
+ * If stamp isn't NULL, it is set to when the kernel received the data read
+ * (SO_TIMESTAMP, set on all accepted sockets), or to now if the kernel didn't
+ * say.
  */
-long NetworkEngine::socket_read(SOCKET s, char *data, std::size_t length) {
+long NetworkEngine::socket_read(SOCKET s, char *data, std::size_t length, std::chrono::steady_clock::time_point* stamp) {
     assert(s != INVALID_SOCKET);
     assert(data != NULL);
     assert(length != 0);
 
-    ssize_t result = recv(s, data, length, 0);
+    #if (PLATFORM == PLATFORM_UNIX) && defined(SCM_TIMESTAMP)
+        ssize_t result;
+        if (stamp == NULL) {
+            result = recv(s, data, length, 0);
+        } else {
+            struct iovec iov = {data, length};
+            alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct timeval))];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            result = recvmsg(s, &msg, 0);
+            *stamp = std::chrono::steady_clock::now();
+            if (result > 0)
+                *stamp = socket_timestamp(&msg, *stamp);
+        }
+    #else
+        ssize_t result = recv(s, data, length, 0);
+        if (stamp != NULL)
+            *stamp = std::chrono::steady_clock::now();
+    #endif
 
     // If received is larger than 0 then the read was successful.
     if (result > 0) {
         assert(result <= static_cast<ssize_t>(length));
-        NetworkEngine::rx_bytes += result;
-        ++NetworkEngine::nsocket_recv;
+        NetworkStats::local().read(result);
         return result;
     }
 
@@ -598,6 +1037,31 @@ long NetworkEngine::socket_read(SOCKET s, char *data, std::size_t length) {
 }
 
 
+#if (PLATFORM == PLATFORM_UNIX) && defined(SCM_TIMESTAMP)
+/***
+ * Finds the SO_TIMESTAMP in the control data of a recvmsg() and moves it onto
+ * the steady clock, by how long ago it was on the wall clock. Returns now if
+ * there is none, or it's in the future (the wall clock was set back).
+ */
+std::chrono::steady_clock::time_point NetworkEngine::socket_timestamp(struct msghdr* msg, std::chrono::steady_clock::time_point now) {
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(msg); c != NULL; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMP)
+            continue;
+
+        struct timeval tv;
+        memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+        std::chrono::system_clock::time_point received = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec)));
+        std::chrono::system_clock::duration age = std::chrono::system_clock::now() - received;
+        if (age <= std::chrono::system_clock::duration::zero())
+            return now;
+        return now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(age);
+    }
+    return now;
+}
+#endif
+
+
 /***
  * Closes the given socket.
  */
@@ -615,6 +1079,22 @@ void NetworkEngine::socket_close(SOCKET s) {
 }
 
 
+/***
+ * Shuts down the connection without closing the socket, so whichever thread
+ * is polling it notices and disconnects it the usual way.
+ */
+void NetworkEngine::socket_shutdown(SOCKET s) {
+    assert(s != INVALID_SOCKET);
+
+    sys::log::NetworkEngine::debug("socket (%i): shutdown", s);
+    #if (PLATFORM == PLATFORM_WINDOWS)
+        ::shutdown(s, SD_BOTH);
+    #elif (PLATFORM == PLATFORM_UNIX)
+        ::shutdown(s, SHUT_RDWR);
+    #endif
+}
+
+
 // Wrapper for creating a socket, logging it and detecting/logging errors.
 SOCKET NetworkEngine::socket_create(int type) {
     assert((type == AF_INET) || (type == AF_INET6));
@@ -743,12 +1223,31 @@ bool NetworkEngine::socket_mode_reuseaddr(SOCKET s) {
 }
 
 
+// Wrapper for setting option REUSEPORT for a socket, logging it and detecting/logging errors.
+bool NetworkEngine::socket_mode_reuseport(SOCKET s) {
+    assert(s != INVALID_SOCKET);
+
+    #ifdef SO_REUSEPORT
+        int on = 1;
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, static_cast<const void*>(&on), sizeof(on)) != 0) {
+            sys::log::NetworkEngine::debug("socket (%i): setsockopt (SO_REUSEPORT) - FAILED (%i:%s)", s, get_error_code(), get_error_msg());
+            return false;
+        }
+        sys::log::NetworkEngine::debug("socket (%i): setsockopt (SO_REUSEPORT)", s);
+        return true;
+    #else
+        sys::log::NetworkEngine::debug("socket (%i): setsockopt (SO_REUSEPORT) - FAILED (not supported)", s);
+        return false;
+    #endif
+}
+
+
 // Wrapper for setting option LINGER for a socket, logging it and detecting/logging errors.
 bool NetworkEngine::socket_mode_linger(SOCKET s) {
     assert(s != INVALID_SOCKET);
 
     struct linger ld = {0, 0};
-    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, static_cast<const void*>(&ld), sizeof(ld)) != 0) {
+    if (setsockopt(s, SOL_SOCKET, SO_LINGER, static_cast<const void*>(&ld), sizeof(ld)) != 0) {
         sys::log::NetworkEngine::debug("socket (%i): setsockopt (SO_LINGER) - FAILED (%i:%s)", s, get_error_code(), get_error_msg());
         return false;
     }
@@ -813,6 +1312,25 @@ bool NetworkEngine::socket_mode_nodelay(SOCKET s) {
 }
 
 
+// Wrapper for setting option CORK for a socket. While on only full packets are sent, turning it off sends
+// whatever is left at once. Logs errors only, as it is toggled for every large flush.
+bool NetworkEngine::socket_mode_cork(SOCKET s, bool on) {
+    assert(s != INVALID_SOCKET);
+
+    #if defined(TCP_CORK)
+        int value = on ? 1 : 0;
+        if (setsockopt(s, IPPROTO_TCP, TCP_CORK, static_cast<const void*>(&value), sizeof(value)) != 0) {
+            sys::log::NetworkEngine::debug("socket (%i): setsockopt (TCP_CORK = %i) - FAILED (%i:%s)", s, value, get_error_code(), get_error_msg());
+            return false;
+        }
+        return true;
+    #else
+        (void)on;
+        return false;
+    #endif
+}
+
+
 /***
  * Returns the most recent socket error code.
  */
@@ -39,12 +39,18 @@
 
 #include "config.h"
 #include "NetworkCore.h"
+#include "NetworkSocketTable.h"
+#include "NetworkResolver.h"
+#include "NetworkStats.h"
 
 #include "sys/socket.h" // SOMAXCONN
 #include <thread>       // std::thread
 #include <list>         // std::list<T>
+#include <vector>       // std::vector<T>
 #include <stack>        // std::stack<T>
 #include <cassert>      // assert()
+#include <atomic>       // std::atomic<T>
+#include <chrono>       // std::chrono::steady_clock
 
 
 namespace net {
@@ -62,16 +68,90 @@ class NetworkEngine {
 
 public:
     // NOTE: NetworkEngine run-time (non-)configurable settings.
-    static const bool use_dns_lookup = false;
+    static const bool use_dns_lookup = true;    // Look up the host names of new connections (NetworkResolver).
     static const bool use_ipv4 = true;
     static const bool use_ipv6 = true;
     static const bool use_strict_bind = false;
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        static const bool use_reuseport = true;     // Several accept-threads per address (SO_REUSEPORT).
+    #else
+        static const bool use_reuseport = false;
+    #endif
+    static const unsigned int AcceptThreadsPerAddress = 2;  // Only when use_reuseport is set.
 
     static const std::size_t MaxConnectionsQueued = 128;
+
+    // Running out of file descriptors: the accept-threads keep a spare one to accept and turn away connections
+    // with, and log it at most once every FdWarningInterval seconds. The connection limit is lowered to what we
+    // had when it happened, less FdHeadroom for the descriptors used by anything else.
+    static const int         FdWarningInterval = 60;
+    static const std::size_t FdHeadroom = 16;
     static const std::size_t MaxSocketsPerThread = 512;
     static const std::size_t SocketsPerThreadHigh = MaxSocketsPerThread - 10;
     static const std::size_t SocketsPerThreadLow = MaxSocketsPerThread * 0.75;
+
+    // Recv-threads: how often (ms) the load is balanced between them, and the difference in connections
+    // between the busiest and least busy thread that makes the busiest hand over half of the difference.
+    static const int         RecvBalanceInterval = 5000;
+    static const std::size_t RecvBalanceThreshold = SocketsPerThreadLow / 4;
     static const std::size_t SocketServerOptionListenQueueLength = SOMAXCONN;
+
+    // Send-thread: max fragments per writev(), output a connection may have queued before it's considered
+    // too slow and disconnected, and how often (ms) to retry blocked connections when there's no poll set
+    // to wait for them to become writable (select).
+    static const int         SendMaxFragments = 64;
+    static const std::size_t MaxOutputPerConnection = 1024 * 1024;
+    static const int         SendPollTimeout = 20;
+
+    // Shutdown: how long (ms) the send-thread gets to flush the output left for the connections, the final
+    // message included, before they are closed anyway. Clients keeping up are done long before that.
+    static const int         ShutdownFlushTimeout = 5000;
+
+    // epoll: Edge-triggered sockets are read until they would block, but at most ReadBudgetPerWakeup bytes at a
+    // time before moving on to the next socket. Level-triggered sockets get one read per wakeup.
+    static const bool        EpollEdgeTriggered = true;
+    static const std::size_t ReadBudgetPerWakeup = 256 * 1024;
+
+    // Longest input line (its '\n' included) passed on to the game. Longer lines are dropped and the client is
+    // sent MSG_BufferOverFlow instead.
+    static const std::size_t MaxLineLength = 4096;
+
+    // Input limits of each connection, as token buckets gaining PerSecond tokens a second up to Burst. The
+    // recv-threads enforce them before allocating anything for the input. With use_read_pausing a connection
+    // over its limits isn't read from until the buckets have refilled, which leaves the input with the
+    // kernel (and TCP flow control slows the client down), else the input over the limits is read and
+    // dropped. Either way lines over the line limit are dropped.
+    static const bool        use_input_limits = true;
+    static const bool        use_read_pausing = true;
+    static const std::size_t InputBytesPerSecond = 16 * 1024;
+    static const std::size_t InputBytesBurst = 64 * 1024;
+    static const std::size_t InputLinesPerSecond = 32;
+    static const std::size_t InputLinesBurst = 128;
+
+    // MCCP2 (telnet option 86) is offered to every new connection, and once a client accepts all its output
+    // is deflate compressed. The level goes from 1 (fastest) to 9 (smallest). The window (2^bits bytes) and
+    // memLevel decide how much memory each compressing connection needs, about 2^(bits+2) + 2^(memLevel+9)
+    // bytes. Deflate streams of closed connections are kept for reuse, up to MaxPooledCompressors.
+    static const bool        use_mccp2 = true;
+    static const int         CompressionLevel = 6;
+    static const int         CompressionWindowBits = 13;
+    static const int         CompressionMemLevel = 6;
+    static const std::size_t CompressionChunkSize = 4096;
+    static const std::size_t MaxPooledCompressors = 64;
+
+    // Reverse DNS lookups of new connections are done by ResolverThreads threads of their own, with at most
+    // MaxQueuedLookups waiting (more are skipped). Names are cached for DNSCacheTTL seconds, failed lookups for
+    // DNSNegativeCacheTTL seconds, with at most MaxCachedLookups addresses cached.
+    static const unsigned int ResolverThreads = 2;
+    static const std::size_t  MaxQueuedLookups = 1024;
+    static const std::size_t  MaxCachedLookups = 4096;
+    static const int          DNSCacheTTL = 3600;
+    static const int          DNSNegativeCacheTTL = 300;
+
+    // io_uring: SQ/CQ size and the provided buffers (count must be a power of two) for each recv-thread.
+    static const unsigned int UringRingEntries = MaxSocketsPerThread * 2;
+    static const unsigned int UringBufferCount = 512;
+    static const unsigned int UringBufferSize = 4096;
 //    static const std::size_t SocketServerOptionListenQueueLength = 64;
 
     //
@@ -79,49 +159,72 @@ public:
 
     // Control methods.
     bool initialize(int maxConnections, IPPort port, const char *ipv4, const char *ipv6);   // Initializes communication subsystems.
-    bool close(void);        // Flushes all output and closes connections.
+    bool close(const char* message = NULL);    // Sends message to all, flushes all output and closes connections.
 
     // Information methods.
     unsigned int GetNumConnections(void) {return users_current;}
     unsigned int GetPeakConnections(void) {return users_peak;}
     unsigned int GetTotalConnections(void) {return users_total;}
     std::size_t  GetMaxConnectionsTotal(void) {return _MaxConnectionsTotal;}
+    void         LowerMaxConnectionsTotal(std::size_t n);   // Never raises it.
 
-    uint64_t GetBytesRecv(void) {return rx_bytes;}
-    uint64_t GetBytesSend(void) {return tx_bytes;}
+    uint64_t GetBytesRecv(void) {return NetworkStats::snapshot().BytesRecv();}
+    uint64_t GetBytesSend(void) {return NetworkStats::snapshot().BytesSend();}
+    NetworkStats GetStats(void) {return NetworkStats::snapshot();}
 
     bool empty(void) {if (users_current != 0) return false; return true;}
 
     void LogStatus(void);
 
-    void AddNewConnection(SOCKET s);                    //
+    void AddNewConnection(SOCKET s, const struct sockaddr_storage* addr = NULL, socklen_t size = 0);
     void DisconnectConnection(SocketData* sd);          //
 
+    // NOTE: The SocketData stays valid until the connection is disconnected, threads not owning the
+    //       connection should look it up again rather than keep the pointer.
+    SocketData* GetSocketData(ConnectionID cid) {return SocketTable::instance().lookup(cid);}
+
     void QueueSendMessage(NetworkMessage* m);
+    void QueueSendMessages(NetworkMessage** m, std::size_t n);
+    void SendData(ConnectionID cid, const char* data, std::size_t length);  // Copies the data and queues it.
+    void SendTickData(ConnectionID cid, const char* data, std::size_t length);  // As SendData, but held until FlushTickOutput().
+    void BroadcastTickData(const ConnectionID* cids, std::size_t n, const char* data, std::size_t length);  // One shared copy for all n.
+    void FlushTickOutput(void);                 // Queues the output of this tick. Game-thread only.
+    void StartCompression(ConnectionID cid);    // Compresses all output queued after this (MCCP2).
+    void CloseConnection(ConnectionID cid);     // Closes the connection after this tick's output. Game-thread only.
     void QueueRecvMessage(NetworkMessage* m);
 
     // Socket control methods.
     static SOCKET socket_create(int type);
-    static SOCKET setup_server_socket(int type, const char* host, IPPort port);// Setup a socket for an accept-thread
+    static SOCKET setup_server_socket(int type, const char* host, IPPort port, bool reuseport);// Setup a socket for an accept-thread
     static bool   socket_bind(SOCKET s, int ai_family, const char *bindaddr, IPPort port);
     static void   socket_close(SOCKET s);               // closes socket
+    static void   socket_shutdown(SOCKET s);            // shuts down both directions, but doesn't close
 
     static bool   socket_mode_listen(SOCKET s, int n);  // listen mode
     static bool   socket_mode_nonblocking(SOCKET s);    // non-blocking mode
     static bool   socket_mode_reuseaddr(SOCKET s);      // reuse address mode
+    static bool   socket_mode_reuseport(SOCKET s);      // share address and port with other sockets
     static bool   socket_mode_linger(SOCKET s);         // linger mode
     static bool   socket_mode_ipv6only(SOCKET s);       // IPv6 only (no IPv4 on same socket)
     static bool   socket_mode_keepalive(SOCKET s);      // send keepalive packets
     static bool   socket_mode_timestamp(SOCKET s);      // enable timestamps
     static bool   socket_mode_nodelay(SOCKET s);        // disables TCP packet concatenation
+    static bool   socket_mode_cork(SOCKET s, bool on);  // holds back partial packets while on
 
     static long   socket_send(SOCKET s, const char *data, std::size_t length);    // write to socket
-    static long   socket_read(SOCKET s, char *data, std::size_t length);          // read from socket
+    static long   socket_sendv(SOCKET s, const struct iovec* iov, int count);     // gathered write to socket
+    static long   socket_read(SOCKET s, char *data, std::size_t length,           // read from socket, with the
+                              std::chrono::steady_clock::time_point* stamp = NULL); // kernel's receive time if asked
+
+    #if (PLATFORM == PLATFORM_UNIX) && defined(SCM_TIMESTAMP)
+        static std::chrono::steady_clock::time_point socket_timestamp(struct msghdr* msg, std::chrono::steady_clock::time_point now);
+    #endif
 
     static int         get_error_code(void);        // Get the last error code.
     static const char* get_error_msg(int e = 0);    // Get the string desc for the given, or last, error code.
-    bool               shutdown(void) {return _shutdown;}
-    bool               terminate(void) {return _terminate;}
+    bool               shutdown(void) {return _shutdown.load(std::memory_order_acquire);}
+    bool               terminate(void) {return _terminate.load(std::memory_order_acquire);}
+    bool               draining(void) {return _draining.load(std::memory_order_acquire);}
 
 private:
     NetworkEngine(void);
@@ -131,44 +234,52 @@ private:
     NetworkEngine& operator=(const NetworkEngine&);
 
     void SpawnAcceptThread(const char* name, const char* addr, IPPort port, int type);
-    void SpawnRecvThread(const char* name);
+    NetworkEngineRecv* SpawnRecvThread(const char* name);
     void SpawnSendThread(const char* name);
+    void WakeupSendThread(void);
+
+    bool AssignConnection(SocketData* sd, NetworkEngineRecv* exclude);    // Hands sd to the least loaded recv-thread.
+    NetworkEngineRecv* LeastLoadedRecvThread(NetworkEngineRecv* exclude);
+    void BalanceRecvThreads(void);
 
     std::list<NetworkEngineThread*> threads;
+    std::vector<NetworkEngineAccept*> accept_threads;  // NOTE: Also protected by mutex_threads.
+    std::vector<NetworkEngineRecv*> recv_threads;      // NOTE: Also protected by mutex_threads.
+    std::atomic<int64_t> recv_balance_next;            // When (ms, steady clock) to balance the recv-threads next.
+    std::atomic<NetworkEngineThread*> send_thread;     // NULL until the send-thread has been spawned.
     std::mutex mutex_threads;
 
     char*  server_hostname;
     IPPort server_port;
-    bool   _shutdown;
-    bool   _terminate;
-
-    ConnectionID nextCID;
+    std::atomic<bool> _shutdown;    // Set first, no more connections are accepted and no more input read.
+    std::atomic<bool> _terminate;   // Set last, the send-thread closes the connections and exits.
+    std::atomic<bool> _draining;    // Set once the final output is queued, shutdown waits for it to be flushed.
+    std::atomic<bool> _drained;     // Set by the send-thread once it has written all output.
 
-    unsigned int users_total;    // Total number of connections.
-    unsigned int users_current;  // Number of connections currently.
-    unsigned int users_peak;     // Max number of connections at one time.
-    std::size_t  _MaxConnectionsTotal;
+    std::atomic<unsigned int> users_total;    // Total number of connections.
+    std::atomic<unsigned int> users_current;  // Number of connections currently.
+    std::atomic<unsigned int> users_peak;     // Max number of connections at one time.
+    std::atomic<std::size_t> _MaxConnectionsTotal;
 
     // Work queues for new and disconnected users.
 //    UnorderedQueueMT<SocketData*> uqueue_new;
 //    UnorderedQueueMT<SocketData*> uqueue_remove;
 //    UnorderedQueueMT<NetworkMessage*> messagesToSend;
-    SocketQueue uqueue_new;
+    // NOTE: The queues are lock-free with a single consumer, the send-thread. New connections go straight
+    //       to the inbox of the recv-thread they are assigned to.
     SocketQueue uqueue_remove;
     NetworkQueue messagesToSend;
 
+    // NOTE: Output the game produces during a tick is held here and queued all at once at the end of the tick,
+    //       so the send-thread finds all of it for a connection together and writes it out in one go. Only
+    //       touched by the game-thread.
+    std::vector<NetworkMessage*> tick_output;
 
-    // Statistics
-    // TODO: Package all statistics variables into a struct?
-    //       That way we could return a const reference to it for interested parties, instead of having to
-    //       request them one by one. And we could overload a stream output operator for the struct to
-    //       simplify printing the statistics.
-    static uint64_t rx_bytes;
-    static uint64_t tx_bytes;
-    static uint64_t nsocket_recv;
-    static uint64_t nsocket_send;
-    static uint32_t nsocket_accept;
+    NetworkResolver resolver;
 
+
+    // Statistics
+    // NOTE: Traffic is counted per thread by NetworkStats, see GetStats().
     uint32_t threads_accept;
     uint32_t threads_recv;
     uint32_t threads_send;
@@ -4,10 +4,16 @@
 #include "NetworkEngineAccept.h"
 #include "NetworkEngine.h"
 #include "NetworkCore.h"
+#include "../ThreadPlacement.h"
 
 #if (PLATFORM == PLATFORM_UNIX)
     #include <arpa/inet.h>      // inet_addr()
+    #include <fcntl.h>          // open()
     #include <netdb.h>          // NI_MAXHOST
+    #include <unistd.h>         // close()
+#endif
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+    #include <sys/epoll.h>      // epoll_create1(), epoll_ctl(), epoll_wait()
 #endif
 
 
@@ -15,7 +21,13 @@ namespace net {
 
 
 NetworkEngineAccept::NetworkEngineAccept(const char* n, const char* addr, IPPort port, int type) :
-    server(INVALID_SOCKET)
+    server(INVALID_SOCKET),
+    reserve_fd(-1),
+    fd_warned_at(),
+    n_turned_away(0)
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        , epoll_fd(-1)
+    #endif
 {
     // Allocate memory and copy the name of the thread.
     if (n == NULL) {
@@ -45,7 +57,7 @@ NetworkEngineAccept::NetworkEngineAccept(const char* n, const char* addr, IPPort
     }
 
     // Setup a server listening socket.
-    server = NetworkEngine::setup_server_socket(type, addr, port);
+    server = NetworkEngine::setup_server_socket(type, addr, port, NetworkEngine::use_reuseport);
     if (server == INVALID_SOCKET) {
         sys::log::NetworkEngine::error("<%s> Failed to setup server socket.", name);
         return;
@@ -53,6 +65,37 @@ NetworkEngineAccept::NetworkEngineAccept(const char* n, const char* addr, IPPort
     sys::log::NetworkEngine::debug("socket (%i): server socket for '%s'", server, name);
     sys::log::add("Accepting connections @ ip = %s port = %lu", addr, port);
 
+    #if (PLATFORM == PLATFORM_UNIX)
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (reserve_fd == -1)
+            sys::log::NetworkEngine::warning("<%s> No spare file descriptor (%i:%s), connections can't be turned away if we run out.", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+    #endif
+
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (NetworkEngine::use_reuseport) {
+            epoll_fd = epoll_create1(0);
+            if (epoll_fd == -1) {
+                sys::log::NetworkEngine::error("<%s> Failed to create an epoll file descriptor. Aborting. (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                return;
+            }
+
+            struct epoll_event event;
+            event.data.ptr = &server;
+            event.events = EPOLLIN;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server, &event) == -1) {
+                sys::log::NetworkEngine::error("<%s> epoll_ctl(): adding server socket (%i) - FAILED (%i:%s)", name, server, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                return;
+            }
+
+            // NOTE: Without control we notice shutdown at the next timeout instead.
+            if (control_open() == true) {
+                event.data.ptr = &control;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control, &event) == -1)
+                    control_close();
+            }
+        }
+    #endif
+
     initialized = true;
 
     sys::log::NetworkEngine::debug("NetworkEngineAccept <%s> created", name);
@@ -61,7 +104,14 @@ NetworkEngineAccept::NetworkEngineAccept(const char* n, const char* addr, IPPort
 
 NetworkEngineAccept::~NetworkEngineAccept() {
     NetworkEngine::socket_close(server);
-    NetworkEngine::socket_close(control);
+    #if (PLATFORM == PLATFORM_UNIX)
+        if (reserve_fd != -1)
+            ::close(reserve_fd);
+    #endif
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (epoll_fd != -1)
+            ::close(epoll_fd);
+    #endif
     delete[] name;
     delete t;
 }
@@ -94,7 +144,22 @@ bool NetworkEngineAccept::run(void) {
 
 void NetworkEngineAccept::exec(void) {
     sys::log::NetworkEngine::add("<%s> Starting...", name);
+    ThreadPlacement::instance().place(ThreadPlacement::Accept, name);
+
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (NetworkEngine::use_reuseport)
+            exec_epoll();
+        else
+            exec_blocking();
+    #else
+        exec_blocking();
+    #endif
 
+    sys::log::NetworkEngine::add("<%s> Terminating.", name);
+}
+
+
+void NetworkEngineAccept::exec_blocking(void) {
     struct sockaddr_storage addr;
     socklen_t size = sizeof(addr);
     SOCKET s = INVALID_SOCKET;
@@ -107,102 +172,253 @@ void NetworkEngineAccept::exec(void) {
         s = static_cast<SOCKET>(accept(server, reinterpret_cast<struct sockaddr*>(&addr), &size));
 
         if (s == INVALID_SOCKET) {
-            switch (NetworkEngine::instance().get_error_code()) {
-            case EAGAIN:
-            #if (EAGAIN != EWOULDBLOCK)
-            case EWOULDBLOCK:
-            #endif
-                //  POSIX.1-2001 - Non-blocking sockets with no pending connections. Trying agin.
-                continue;
+            if (accept_failed() == false)
+                sys::log::NetworkEngine::debug("<%s> Error on accept()'ing connection' (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            continue;
+        }
 
-            case EINTR:
-                // NOTE: The system call was interrupted by a signal before finishing. Trying again.
-                continue;
+        // Set appropriate modes for the socket.
+        NetworkEngine::socket_mode_nonblocking(s);
+        NetworkEngine::socket_mode_linger(s);
+        NetworkEngine::socket_mode_keepalive(s);
+        NetworkEngine::socket_mode_timestamp(s);
+        NetworkEngine::socket_mode_nodelay(s);
 
-            case EMFILE:
-            case ENFILE:
-                // FIXME: The process can't open more file descriptors, so log the error but keep on going
-                //        since the error is semi-transient and in any case not fatal for the already
-                //        established connections. We should log this error once every minute or so, and
-                //        the first time we should also decrease the maximum number of allowed connections.
-                continue;
+        add_connection(s, addr, size);
+    }
+}
 
-            case ENETDOWN:
-            case EPROTO:
-            case ENOPROTOOPT:
-            case EHOSTDOWN:
-            case ENONET:
-            case EHOSTUNREACH:
-            case EOPNOTSUPP:
-            case ENETUNREACH:
-                // NOTE: Possibly leftover errors from a previous connection if the socket was recently
-                //       reused. We'll let them pass, but maybe we should keep track of how many of these
-                //       we get and after some threshold report them too.
-                continue;
 
-            case EBADF:
-            case EFAULT:
-            case EINVAL:
-            case ENOTSOCK:
-                // NOTE: One, or more, of the arguments are bad so we'll abort.
-                break;
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+/***
+ * Waits for the (non-blocking) listener to become readable, then accepts all
+ * pending connections in one go. Several of these threads can share the same
+ * address and port with SO_REUSEPORT, the kernel spreads new connections
+ * between their listeners.
+ */
+void NetworkEngineAccept::exec_epoll(void) {
+    struct epoll_event events[2];
+
+    for (;;) {
+        // NOTE: From here on shutdown wakes us up through control.
+        wait_begin();
+        if (NetworkEngine::instance().shutdown())
+            break;
+
+        // FIXME: Remove that "magic" value for the timeout time.
+        int eventCount = epoll_wait(epoll_fd, events, 2, 1000);
+        wait_end();
+        if (eventCount == -1) {
+            if (NetworkEngine::get_error_code() == EINTR)
+                continue;
+            sys::log::NetworkEngine::error("<%s> epoll_wait() - FAILED (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            break;
+        }
 
-            default:
-                break;
+        for (int i = 0; i < eventCount; i++) {
+            if (events[i].data.ptr == &control) {
+                control_clear();
+            } else {
+                accept_connections();
             }
-            sys::log::NetworkEngine::debug("<%s> Error on accept()'ing connection' (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
-            continue;
         }
+    }
+}
 
-        // NOTE: If we are either limited by select()-based polling or max open file descriptors we drop
-        //       connections (hopefully) slightly before reaching that limit.
-        if (NetworkEngine::instance().GetNumConnections() >= NetworkEngine::instance().GetMaxConnectionsTotal()) {
-            sys::log::NetworkEngine::add("<%s> Max connection limit reached. Dropping connection.", name);
-            sys::log::NetworkEngine::debug("socket (%i): accepted - FAILED (Connection Limit Reached)", s);
-            NetworkEngine::socket_close(s);
-            continue;
-        }
-        #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
-        if (s >= FD_SETSIZE) {
-            sys::log::NetworkEngine::add("<%s> Too many open file descriptors. Dropping connection.", name);
-            sys::log::NetworkEngine::debug("socket (%i): accepted - FAILED (Too many open file descriptors)", s);
-            NetworkEngine::socket_close(s);
-            continue;
+
+/***
+ * Accepts connections until there are no more pending. accept4() makes the
+ * new sockets non-blocking in the same call, and the listener was set up with
+ * the options we want (linger, keepalive, timestamp, nodelay), which the new
+ * sockets inherit, so there is nothing more to set.
+ */
+void NetworkEngineAccept::accept_connections(void) {
+    std::size_t accepted = 0;
+
+    for (;;) {
+        struct sockaddr_storage addr;
+        socklen_t size = sizeof(addr);
+
+        SOCKET s = static_cast<SOCKET>(accept4(server, reinterpret_cast<struct sockaddr*>(&addr), &size, SOCK_NONBLOCK | SOCK_CLOEXEC));
+        if (s == INVALID_SOCKET) {
+            int e = NetworkEngine::get_error_code();
+            if (e == EAGAIN || e == EWOULDBLOCK)
+                break;
+            if (accept_failed() == true)
+                continue;
+            sys::log::NetworkEngine::debug("<%s> Error on accept4()'ing connection' (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            break;
         }
-        #endif
 
-        sys::log::NetworkEngine::debug("socket (%i): accepted", s);
+        add_connection(s, addr, size);
+        ++accepted;
+    }
 
-        // Set appropriate modes for the socket.
-        NetworkEngine::socket_mode_nonblocking(s);
-        NetworkEngine::socket_mode_linger(s);
-        NetworkEngine::socket_mode_keepalive(s);
-        NetworkEngine::socket_mode_timestamp(s);
+    sys::log::NetworkEngine::debug("<%s> %lu connection(s) accepted", name, accepted);
+}
+#endif // (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+
+
+/***
+ * Checks the error of a failed accept(). Returns true if it was transient and
+ * we should just try again.
+ */
+bool NetworkEngineAccept::accept_failed(void) {
+    switch (NetworkEngine::instance().get_error_code()) {
+    case EAGAIN:
+    #if (EAGAIN != EWOULDBLOCK)
+    case EWOULDBLOCK:
+    #endif
+        //  POSIX.1-2001 - Non-blocking sockets with no pending connections. Trying agin.
+        return true;
+
+    case EINTR:
+        // NOTE: The system call was interrupted by a signal before finishing. Trying again.
+        return true;
+
+    case ECONNABORTED:
+        // NOTE: The connection was aborted by the peer before we got to it. Trying again.
+        return true;
+
+    case EMFILE:
+    case ENFILE:
+        // NOTE: The process (or system) can't open more file descriptors. Not fatal for the connections
+        //       we already have, and it passes as they close, so turn the pending ones away meanwhile.
+        return out_of_descriptors(NetworkEngine::instance().get_error_code());
+
+    case ENETDOWN:
+    case EPROTO:
+    case ENOPROTOOPT:
+    case EHOSTDOWN:
+    case ENONET:
+    case EHOSTUNREACH:
+    case EOPNOTSUPP:
+    case ENETUNREACH:
+        // NOTE: Possibly leftover errors from a previous connection if the socket was recently
+        //       reused. We'll let them pass, but maybe we should keep track of how many of these
+        //       we get and after some threshold report them too.
+        return true;
+
+    case EBADF:
+    case EFAULT:
+    case EINVAL:
+    case ENOTSOCK:
+        // NOTE: One, or more, of the arguments are bad so we'll abort.
+        break;
 
-        #ifdef DEBUG
-            int size_send = -1, size_recv = -1;
-            socklen_t length = sizeof(socklen_t);
-            getsockopt(s, SOL_SOCKET, SO_SNDBUF, static_cast<void*>(&size_send), &length);
-            getsockopt(s, SOL_SOCKET, SO_RCVBUF, static_cast<void*>(&size_recv), &length);
-            sys::log::NetworkEngine::debug("socket (%i): buffers (send=%i KiB, recv=%i KiB)", s, size_send/1024, size_recv/1024);
-        #endif // DEBUG
-
-        char peer_name[NI_MAXHOST] = {"<unknown>"}, peer_ip[128], peer_port[8];
-        // Make a DNS lookup for the domain name of the connected host.
-        if (NetworkEngine::use_dns_lookup) {
-            if (getnameinfo (reinterpret_cast<struct sockaddr*>(&addr), size, peer_name, sizeof(peer_name), NULL, 0, 0) != 0) {
-                strcpy(peer_name, "<unknown>");
+    default:
+        break;
+    }
+    return false;
+}
+
+
+/***
+ * Called when accept() fails for lack of file descriptors. The connection is
+ * still pending then, and keeps the listener readable, so we would just fail
+ * again right away. Instead the spare descriptor is given up to accept it
+ * with, and it is told the game is full and closed. The connection limit is
+ * lowered so we stop accepting before running out next time (unless most
+ * descriptors are used by something else), and the whole thing is logged at
+ * most once every FdWarningInterval seconds.
+ *
+ * Returns true if a connection was turned away, so accepting should go on.
+ * Without a spare descriptor to use, we back off for a moment instead.
+ */
+bool NetworkEngineAccept::out_of_descriptors(int error) {
+    NetworkEngine& engine = NetworkEngine::instance();
+    std::size_t connections = engine.GetNumConnections();
+    std::size_t headroom = NetworkEngine::FdHeadroom;
+    if (connections > headroom)
+        engine.LowerMaxConnectionsTotal(connections - headroom);
+
+    bool turned_away = false;
+    #if (PLATFORM == PLATFORM_UNIX)
+        if (reserve_fd != -1) {
+            ::close(reserve_fd);
+            SOCKET s = static_cast<SOCKET>(accept(server, NULL, NULL));
+            if (s != INVALID_SOCKET) {
+                reject_connection(s);
+                turned_away = true;
             }
+            reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
         }
-        // Get the IP address of the new connection.
-        if (getnameinfo (reinterpret_cast<struct sockaddr*>(&addr), size, peer_ip, sizeof(peer_ip), peer_port, 8, NI_NUMERICHOST) != 0) {
-           strcpy(peer_ip, "<unknown>");
-        }
-        sys::log::NetworkEngine::add("socket (%i): peer = %s (ip = %s port = %s) (server: %s)", s, peer_name, peer_ip, peer_port, name);
-        NetworkEngine::instance().AddNewConnection(s); // Register the connection as alive.
+    #endif
+    if (turned_away)
+        ++n_turned_away;
+
+    int interval = NetworkEngine::FdWarningInterval;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (fd_warned_at == std::chrono::steady_clock::time_point() || now - fd_warned_at >= std::chrono::seconds(interval)) {
+        sys::log::NetworkEngine::warning("<%s> Out of file descriptors (%i:%s) with %lu connection(s), %lu turned away%s",
+                name, error, NetworkEngine::get_error_msg(error), connections, n_turned_away, (reserve_fd == -1) ? ", no spare descriptor left" : "");
+        fd_warned_at = now;
+        n_turned_away = 0;
     }
 
-    sys::log::NetworkEngine::add("<%s> Terminating.", name);
+    if (!turned_away) {
+        // NOTE: Nothing we can do about the pending connection, so don't spin on it.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return turned_away;
+}
+
+
+/***
+ * Tells the connection the game is full and closes it.
+ */
+void NetworkEngineAccept::reject_connection(SOCKET s) {
+    // NOTE: Best effort, a new socket has room for this in its buffer so it never blocks.
+    #if (PLATFORM == PLATFORM_UNIX)
+        send(s, MSG_GameFull, sizeof(MSG_GameFull) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    #else
+        NetworkEngine::socket_send(s, MSG_GameFull, sizeof(MSG_GameFull) - 1);
+    #endif
+    NetworkEngine::socket_close(s);
+}
+
+
+/***
+ * Checks the connection limits, logs the new connection and hands it over to
+ * NetworkEngine. The socket modes have already been set.
+ */
+void NetworkEngineAccept::add_connection(SOCKET s, struct sockaddr_storage& addr, socklen_t size) {
+    // NOTE: If we are either limited by select()-based polling or max open file descriptors we drop
+    //       connections (hopefully) slightly before reaching that limit.
+    if (NetworkEngine::instance().GetNumConnections() >= NetworkEngine::instance().GetMaxConnectionsTotal()) {
+        sys::log::NetworkEngine::add("<%s> Max connection limit reached. Dropping connection.", name);
+        sys::log::NetworkEngine::debug("socket (%i): accepted - FAILED (Connection Limit Reached)", s);
+        reject_connection(s);
+        return;
+    }
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+    if (s >= FD_SETSIZE) {
+        sys::log::NetworkEngine::add("<%s> Too many open file descriptors. Dropping connection.", name);
+        sys::log::NetworkEngine::debug("socket (%i): accepted - FAILED (Too many open file descriptors)", s);
+        NetworkEngine::socket_close(s);
+        return;
+    }
+    #endif
+
+    sys::log::NetworkEngine::debug("socket (%i): accepted", s);
+
+    #ifdef DEBUG
+        int size_send = -1, size_recv = -1;
+        socklen_t length = sizeof(socklen_t);
+        getsockopt(s, SOL_SOCKET, SO_SNDBUF, static_cast<void*>(&size_send), &length);
+        getsockopt(s, SOL_SOCKET, SO_RCVBUF, static_cast<void*>(&size_recv), &length);
+        sys::log::NetworkEngine::debug("socket (%i): buffers (send=%i KiB, recv=%i KiB)", s, size_send/1024, size_recv/1024);
+    #endif // DEBUG
+
+    // NOTE: Only the numeric address here, the host name is looked up by NetworkResolver so we never wait
+    //       on a resolver.
+    char peer_ip[128], peer_port[8];
+    if (getnameinfo (reinterpret_cast<struct sockaddr*>(&addr), size, peer_ip, sizeof(peer_ip), peer_port, 8, NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+       strcpy(peer_ip, "<unknown>");
+       strcpy(peer_port, "?");
+    }
+    sys::log::NetworkEngine::add("socket (%i): peer = %s port %s (server: %s)", s, peer_ip, peer_port, name);
+    NetworkEngine::instance().AddNewConnection(s, &addr, size); // Register the connection as alive.
 }
 
 } // namespace net
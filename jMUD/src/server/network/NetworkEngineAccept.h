@@ -5,8 +5,13 @@
 #include "UnorderedArray.h" // UnorderedArray
 #include "NetworkCore.h"
 
+#include <chrono>           // std::chrono::steady_clock
 #include <mutex>            // std::mutex
 
+#if (PLATFORM == PLATFORM_UNIX)
+    #include <sys/socket.h>     // struct sockaddr_storage, socklen_t
+#endif
+
 
 namespace net {
 
@@ -23,8 +28,26 @@ private:
     NetworkEngineAccept& operator=(const NetworkEngineAccept&);
 
     void exec(void);
+    void exec_blocking(void);
+    bool accept_failed(void);
+    bool out_of_descriptors(int error);
+    void reject_connection(SOCKET s);
+    void add_connection(SOCKET s, struct sockaddr_storage& addr, socklen_t size);
 
     SOCKET server;
+
+    // NOTE: A spare descriptor, given up to accept a connection with when we run out so it can be turned away
+    //       rather than left in the backlog (where it would keep the listener readable).
+    int reserve_fd;
+    std::chrono::steady_clock::time_point fd_warned_at;    // Last out of descriptors warning.
+    std::size_t n_turned_away;                              // Turned away since then.
+
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        void exec_epoll(void);
+        void accept_connections(void);
+
+        int epoll_fd;
+    #endif
 };
 
 
@@ -4,9 +4,10 @@
 #include "NetworkEngine.h"
 #include "NetworkCore.h"
 #include "../GameEngine.h"
+#include "../ThreadPlacement.h"
 
 #include <mutex>                // std::mutex
-#include <algorithm>            // find(...)
+#include <algorithm>            // std::min(), std::max(), std::find()
 #include <sys/types.h>          // *for compability*
 #include <sys/socket.h>         // getsockopt()
 #include <functional>
@@ -18,12 +19,27 @@ namespace net {
 NetworkEngineRecv::NetworkEngineRecv(const char *n) :
     mutex_data(),
     sockets(),
+    buffers(),
+    telnet_lines(),
+    telnet_events(),
+    paused(),
+    n_throttled(0),
+    n_dropped_bytes(0),
+    n_dropped_lines(0),
+    inbox(),
+    load(0),
+    state(Active),
+    shedding(0),
+    wakeup_stats(),
     #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
         socket_max(-1)
     #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
         epoll_fd(-1),
         event(),
-        events(NULL)
+        events(NULL),
+        ready()
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        ring()
     #endif
 {
     // Allocate memory and copy the name of the thread.
@@ -39,7 +55,20 @@ NetworkEngineRecv::NetworkEngineRecv(const char *n) :
         strcpy(name, n);
     }
 
-    #if (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+    if (control_open() == false) {
+        sys::log::NetworkEngine::warning("<%s> Failed to create an eventfd, new connections will only be noticed every poll. (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+    }
+
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wold-style-cast"
+        FD_ZERO(&fdset);
+        if (control != INVALID_SOCKET) {
+            FD_SET(control, &fdset);
+            socket_max = control + 1;
+        }
+        #pragma GCC diagnostic pop
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
         epoll_fd = epoll_create1 (0);
         if (epoll_fd == -1) {
             sys::log::NetworkEngine::error("<%s> Failed to create an epoll file descriptor. Aborting. (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
@@ -52,9 +81,34 @@ NetworkEngineRecv::NetworkEngineRecv(const char *n) :
             sys::log::NetworkEngine::error("<%s> Failed to allocate events structure for epoll. Aborting. (%i:%s)");
             return;
         }
+        ready.reserve(NetworkEngine::MaxSocketsPerThread);
+
+        // NOTE: control is told apart from the sockets by its data.ptr pointing at it, not a SocketData.
+        if (control != INVALID_SOCKET) {
+            event.data.ptr = &control;
+            event.events = EPOLLIN;
+            if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, control, &event) == -1) {
+                sys::log::NetworkEngine::error("<%s> epoll_ctl(): adding eventfd (%i) - FAILED (%i:%s)", name, control, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                control_close();
+            }
+        }
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        // NOTE: Every armed socket can have a completion in flight at the same time, so size the ring for
+        //       a full thread. The provided buffers are shared by all sockets in the thread.
+        if (ring.setup(NetworkEngine::UringRingEntries) == false) {
+            sys::log::NetworkEngine::error("<%s> Failed to create an io_uring instance. Aborting.", name);
+            return;
+        }
+        if (ring.setup_buffer_ring(0, NetworkEngine::UringBufferCount, NetworkEngine::UringBufferSize) == false) {
+            sys::log::NetworkEngine::error("<%s> Failed to register io_uring provided buffers. Aborting.", name);
+            return;
+        }
+        if (control != INVALID_SOCKET)
+            ring.prepare_poll_multishot(control, reinterpret_cast<uint64_t>(&control));
     #endif
 
     sockets.reserve(NetworkEngine::MaxSocketsPerThread);
+    paused.reserve(NetworkEngine::MaxSocketsPerThread);
     initialized = true;
 
     sys::log::NetworkEngine::debug("NetworkEngineRecv <%s> created", name);
@@ -102,30 +156,43 @@ void NetworkEngineRecv::exec(void) {
     assert(running == false);
 
     sys::log::NetworkEngine::add("<%s> Starting...", name);
-//    struct timespec req = { 0, 500 * 1000*1000};   // 1000 ms
-    struct timespec req = { 1, 0};   // 1000 ms
-    struct timespec res = { 0, 0};
+    // NOTE: Pin the thread before it allocates its buffers, so they're first touched (and get their pages)
+    //       on the NUMA node the thread runs on.
+    ThreadPlacement::instance().place(ThreadPlacement::Recv, name);
+    buffers.staging();
     #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
         struct timeval  tv  = { 0, 500 * 1000};   // 500 ms
     #endif
 
     running = true;
     while (!NetworkEngine::instance().shutdown()) {
+        // NOTE: From here on a new connection (or shutdown) wakes us up through control.
+        wait_begin();
 
-        if (!NetworkEngine::instance().uqueue_new.empty() && (sockets.size() < NetworkEngine::MaxSocketsPerThread)) {
+        if (!inbox.empty() && (sockets.size() < NetworkEngine::MaxSocketsPerThread)) {
             sys::log::NetworkEngine::debug("<%s> fetching new connections...", name);
             fetch_new_connections();
         }
 
+        if (shedding.load(std::memory_order_relaxed) > 0) {
+            sys::log::NetworkEngine::debug("<%s> handing over connections...", name);
+            migrate_connections();
+        }
+
+        NetworkEngine::instance().BalanceRecvThreads();
+        resume_reading();
+
         if (!sockets.empty()) {
             #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
 
                 fd_set recvset;
                 memcpy(&recvset, &fdset, sizeof(fd_set));
 
-                tv.tv_sec = 0; tv.tv_usec = 500 * 1000;   // 500 ms
+                int timeout = resume_timeout(500);
+                tv.tv_sec = timeout / 1000; tv.tv_usec = (timeout % 1000) * 1000;   // 500 ms, or until a paused socket resumes
 //                sys::log::NetworkEngine::debug("<%s> %lu connection(s) - blocking on select (max %lis %lims %lius)", name, sockets.size(), tv.tv_sec, tv.tv_usec / 1000, tv.tv_usec % 1000);
                 int readySockets = select(socket_max, &recvset, NULL, NULL, &tv);
+                wait_end();
                 if (readySockets == -1) {
                     if (NetworkEngine::get_error_code() == EBADF) {
                         sys::log::NetworkEngine::add("<%s> select() reported bad file descriptors. Purging bad ones.", name);
@@ -141,23 +208,27 @@ void NetworkEngineRecv::exec(void) {
 
                 if (readySockets > 0 ) {
                     sys::log::NetworkEngine::debug("<%s> %lu connection(s) - processing input from %i connection(s)", name, sockets.size(), readySockets);
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    std::size_t nSockets = sockets.size();
                     mutex_data.lock();
 
-                    std::vector<SocketData*>::iterator it = sockets.begin();
-                    while (it != sockets.end()) {
-                        if (FD_ISSET((*it)->s, &recvset)) {
-//                            sys::log::NetworkEngine::verbose("<%s> socket (%i): has input available", name, (*it)->s);
-                            if (read_data(*it) == false) {
-                                FD_CLR((*it)->s, &fdset);  // Remove from our fd_set.
-                                NetworkEngine::instance().DisconnectConnection(*it);   //
-                                it = sockets.erase(it); // Erase from the connection list.
+                    std::size_t i = 0;
+                    while (i < sockets.size()) {
+                        SocketData* sd = sockets[i];
+                        if (FD_ISSET(sd->s, &recvset)) {
+//                            sys::log::NetworkEngine::verbose("<%s> socket (%i): has input available", name, sd->s);
+                            if (read_data(sd) == false) {
+                                FD_CLR(sd->s, &fdset);  // Remove from our fd_set.
+                                remove_socket(sd);      // NOTE: Moves the last socket into slot i, so check i again.
+                                continue;
                             }
                         }
-//                        if (it == sockets.end())
-//                            break;
-                        ++it;
+                        ++i;
                     }
+                    if (control != INVALID_SOCKET && FD_ISSET(control, &recvset))
+                        control_clear();
                     mutex_data.unlock();
+                    record_wakeup(nSockets, readySockets, std::chrono::steady_clock::now() - start);
                 } else {
 //                    sys::log::NetworkEngine::debug("<%s> %lu connection(s) - zero input", name, sockets.size());
                 }
@@ -165,7 +236,9 @@ void NetworkEngineRecv::exec(void) {
             #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
 
                 // FIXME: Remove that "magic" value for the timeout time.
-                int eventCount = epoll_wait(epoll_fd, events, NetworkEngine::MaxSocketsPerThread, 500);
+                // NOTE: Don't block while there are sockets that still have input left to read.
+                int eventCount = epoll_wait(epoll_fd, events, NetworkEngine::MaxSocketsPerThread, ready.empty() ? resume_timeout(500) : 0);
+                wait_end();
                 if (eventCount == -1) {
                     if (NetworkEngine::get_error_code() == EINTR)
                         continue;
@@ -173,134 +246,317 @@ void NetworkEngineRecv::exec(void) {
                     break;
                 }
 
-                if (eventCount > 0 ) {
+                if (eventCount > 0 || !ready.empty()) {
                     sys::log::NetworkEngine::debug("<%s> %lu connection(s) - processing events from %i connection(s).", name, sockets.size(), eventCount);
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    std::size_t nSockets = sockets.size();
                     mutex_data.lock();
 
                     for (unsigned int i = 0; i < static_cast<unsigned int>(eventCount); i++) {
-
-                        // TODO: Couldn't this be done in a more elegant way? Since we can get any data
-                        //       we want back couldn't we avoid doing any search...
-                        //       Of course it is possible, just use the data directly and only search
-                        //       for its location in the "list" if it needs to be removed.
-                        std::vector<SocketData*>::iterator it;
-                        it = find(sockets.begin(), sockets.end(), static_cast<SocketData*>(events[i].data.ptr));
-                        if (it == sockets.end()) {
-                            sys::log::NetworkEngine::error("<%s> socket (??): returned from epoll_wait() but not found in connection list.", name);
+                        if (events[i].data.ptr == &control) {
+                            control_clear();
                             continue;
                         }
 
-                        if ((events[i].events & EPOLLIN) || (events[i].events & EPOLLPRI)) {
-                            sys::log::NetworkEngine::verbose("<%s> socket (%i): has input available", name, (*it)->s);
-                            if (read_data(*it) == true)
+                        // NOTE: The event carries the SocketData, which knows its own slot, so there is
+                        //       nothing to search for.
+                        SocketData* sd = static_cast<SocketData*>(events[i].data.ptr);
+                        assert(sd->slot < sockets.size() && sockets[sd->slot] == sd);
+
+                        if (NetworkEngine::EpollEdgeTriggered) {
+                            // Already waiting in the ready list, it will get its turn below.
+                            if (sd->rx_pending)
+                                continue;
+                            if ((events[i].events & EPOLLIN) || (events[i].events & EPOLLPRI) || (events[i].events & EPOLLRDHUP)) {
+                                sys::log::NetworkEngine::verbose("<%s> socket (%i): has input available", name, sd->s);
+                                if (drain_data(sd, (events[i].events & EPOLLRDHUP) != 0) == true)
+                                    continue;
+                            }
+                        } else if ((events[i].events & EPOLLIN) || (events[i].events & EPOLLPRI)) {
+                            sys::log::NetworkEngine::verbose("<%s> socket (%i): has input available", name, sd->s);
+                            if (read_data(sd) == true)
                                 continue;
                         }
 
                         // If we get here no input was available, so some error occured and we will close
                         // and remove the socket.
-                        sys::log::NetworkEngine::verbose("<%s> socket (%i): removing", name, (*it)->s);
+                        sys::log::NetworkEngine::verbose("<%s> socket (%i): removing", name, sd->s);
                         if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP) || (events[i].events & EPOLLRDHUP)) {
-                            sys::log::NetworkEngine::error("<%s> socket (%i): ERROR (%i:%s)", name, (*it)->s, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                            sys::log::NetworkEngine::error("<%s> socket (%i): ERROR (%i:%s)", name, sd->s, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
                         }
-                        epoll_ctl (epoll_fd, EPOLL_CTL_DEL, (*it)->s, NULL);
-                        NetworkEngine::instance().DisconnectConnection(*it);   //
-                        it = sockets.erase(it);
+                        epoll_ctl (epoll_fd, EPOLL_CTL_DEL, sd->s, NULL);
+                        remove_socket(sd);
                     }
 
+                    if (NetworkEngine::EpollEdgeTriggered)
+                        process_ready();
+
                     mutex_data.unlock();
+                    record_wakeup(nSockets, eventCount, std::chrono::steady_clock::now() - start);
                 } else {
 //                    sys::log::NetworkEngine::debug("<%s> %lu connection(s) - zero input", name, sockets.size());
                 }
 
+            #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+
+                // NOTE: Arming new sockets and re-arming terminated multishot recvs are only prepared, they
+                //       are all handed to the kernel here in the same io_uring_enter() that waits for input.
+                // FIXME: Remove that "magic" value for the timeout time.
+                int result = ring.submit_and_wait(1, resume_timeout(500));
+                wait_end();
+                if (result < 0 && result != -ETIME && result != -EINTR) {
+                    sys::log::NetworkEngine::debug("<%s> io_uring_enter() - FAILED (%i:%s)", name, -result, NetworkEngine::get_error_msg(-result));
+                    break;
+                }
+
+                unsigned int ready = ring.cq_ready();
+                if (ready > 0) {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    std::size_t nSockets = sockets.size();
+                    mutex_data.lock();
+                    process_completions();
+                    mutex_data.unlock();
+                    record_wakeup(nSockets, ready, std::chrono::steady_clock::now() - start);
+                }
+
             #endif // (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
 
         } else {
-            sys::log::NetworkEngine::verbose("<%s> 0 connections (sleeping for max %lis %lims %lius %lins)", name, req.tv_sec, req.tv_nsec / 1000000, (req.tv_nsec % 1000000) / 1000, req.tv_nsec % 1000);
+            sys::log::NetworkEngine::verbose("<%s> 0 connections (waiting for max 1000 ms)", name);
             // In the case we got woken up early because of a signal we just continue as if nothing
-            // happened since we don't really care exactly how long we slept, just that we do sleep some.
-            nanosleep(&req, &res);
+            // happened since we don't really care exactly how long we waited, just that we do wait some.
+            control_wait(1000);
+            wait_end();
         }
     }
 
+    // NOTE: Only reading stops here, the connections stay open until the send-thread has flushed their output
+    //       (NetworkEngine::close()) and is the one closing them.
     if (!sockets.empty()) {
-        std::size_t size_old = sockets.size();
-        sys::log::NetworkEngine::debug("<%s> %lu connection(s) - autoclosing...", name, sockets.size());
-        for (size_t i = 0; i < sockets.size(); i++) {
-            sys::log::NetworkEngine::verbose("<%s>   socket (%i): autoclosed", name, sockets.at(i)->s);
-            #if (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+        sys::log::NetworkEngine::debug("<%s> %lu connection(s) - stopped reading", name, sockets.size());
+        #if (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+            for (size_t i = 0; i < sockets.size(); i++) {
                 epoll_ctl (epoll_fd, EPOLL_CTL_DEL, sockets.at(i)->s, NULL);
-            #endif
-            NetworkEngine::instance().DisconnectConnection(sockets.at(i));   //
-        }
-        sys::log::NetworkEngine::debug("<%s> %lu connection(s) - autoclosed", name, size_old - sockets.size());
+            }
+        #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+            for (size_t i = 0; i < sockets.size(); i++) {
+                ring.prepare_cancel(reinterpret_cast<uint64_t>(sockets.at(i)));
+            }
+            ring.submit();
+        #endif
     }
 
+    buffers.LogStatus(name);
+    log_wakeups();
     sys::log::NetworkEngine::add("<%s> Terminating.", name);
 }
 
 
 void NetworkEngineRecv::fetch_new_connections(void) {
-    NetworkEngine::instance().uqueue_new.lock();
-
+    SocketData* fetched[64];
     std::size_t size_old = sockets.size();
-    while (!NetworkEngine::instance().uqueue_new.empty() && (sockets.size() < NetworkEngine::MaxSocketsPerThread)) {
-        SocketData* sd = NetworkEngine::instance().uqueue_new.pop();
-
-        sys::log::NetworkEngine::debug("<%s> adding socket = %i with cid = %u", name, sd->s, sd->cid);
+    std::size_t room = NetworkEngine::MaxSocketsPerThread - sockets.size();
+    std::size_t nFetched = inbox.pop(fetched, std::min(room, sizeof(fetched) / sizeof(fetched[0])));
 
-        #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wold-style-cast"
-            FD_SET(sd->s, &fdset);
-            #pragma GCC diagnostic pop
-            socket_max = std::max(socket_max, sd->s + 1);
-        #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
-//            event.data.fd = sd->s;
-// TODO: Pass a pointer to the appropriate SocketData for each socket watched.
-            event.data.ptr = sd;
-            event.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
-            if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, sd->s, &event) == -1) {
-                sys::log::NetworkEngine::error("<%s> epoll_ctl(): adding socket (%i) - FAILED (%i:%s)", name, sd->s, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
-                NetworkEngine::instance().DisconnectConnection(sd);
-                continue;
-            }
-        #endif
+    for (std::size_t i = 0; i < nFetched; i++) {
+        SocketData* sd = fetched[i];
 
+        sys::log::NetworkEngine::debug("<%s> adding socket = %i with cid = %u", name, sd->s, sd->cid);
+        if (watch_socket(sd) == false) {
+            load--;
+            NetworkEngine::instance().DisconnectConnection(sd);
+            continue;
+        }
         sys::log::NetworkEngine::verbose("<%s>   socket (%i): transfered", name, sd->s);
-        sockets.push_back(sd);
     }
-    NetworkEngine::instance().uqueue_new.unlock();
 
     #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
         sys::log::NetworkEngine::verbose("<%s>   socket_max = %i", name, socket_max);
     #endif
     sys::log::NetworkEngine::debug("<%s> %lu connection(s) transfered @ %i/%i connections", name, sockets.size() - size_old, sockets.size(), NetworkEngine::MaxSocketsPerThread);
+}
+
+
+/***
+ * Starts polling the socket and adds it to the list of sockets.
+ */
+bool NetworkEngineRecv::watch_socket(SocketData* sd) {
+    if (arm_socket(sd) == false)
+        return false;
+
+    add_socket(sd);
+    return true;
+}
+
+
+/***
+ * Starts polling the socket, for a new connection or one that was paused.
+ */
+bool NetworkEngineRecv::arm_socket(SocketData* sd) {
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wold-style-cast"
+        FD_SET(sd->s, &fdset);
+        #pragma GCC diagnostic pop
+        socket_max = std::max(socket_max, sd->s + 1);
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+        event.data.ptr = sd;
+        event.events = EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP;
+        if (NetworkEngine::EpollEdgeTriggered)
+            event.events |= EPOLLET | EPOLLRDHUP;
+        if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, sd->s, &event) == -1) {
+            sys::log::NetworkEngine::error("<%s> epoll_ctl(): adding socket (%i) - FAILED (%i:%s)", name, sd->s, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            return false;
+        }
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        if (ring.prepare_recv_multishot(sd->s, reinterpret_cast<uint64_t>(sd)) == false) {
+            sys::log::NetworkEngine::error("<%s> io_uring: arming socket (%i) - FAILED (submission queue full)", name, sd->s);
+            return false;
+        }
+    #endif
+
+    return true;
+}
+
 
-    if (NetworkEngine::instance().users_current > (NetworkEngine::instance().threads_recv * NetworkEngine::SocketsPerThreadHigh)) {
-        char n[16];
-        snprintf(n, 15, "Recv%u:", NetworkEngine::instance().threads_recv + 1);
-        NetworkEngine::instance().SpawnRecvThread(n);
-        NetworkEngine::instance().LogStatus();
+/***
+ * Hands over connections to other recv-threads, as asked to by shed() or
+ * retire(). With io_uring the multishot recv of the connection has to be
+ * cancelled first, so the connection is only handed over once its last
+ * completion arrives (see process_completions()).
+ */
+void NetworkEngineRecv::migrate_connections(void) {
+    std::size_t wanted = shedding.load(std::memory_order_acquire);
+    std::size_t moved = 0;
+
+    std::size_t i = sockets.size();
+    while (moved < wanted && i > 0) {
+        SocketData* sd = sockets[--i];
+        // NOTE: Paused connections aren't polled, so they are left for later.
+        if (sd->rx_paused)
+            continue;
+
+        #if (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+            if (sd->rx_migrating)
+                continue;
+            if (ring.prepare_cancel(reinterpret_cast<uint64_t>(sd)) == false)
+                break;
+            sd->rx_migrating = true;
+        #else
+            #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+                #pragma GCC diagnostic push
+                #pragma GCC diagnostic ignored "-Wold-style-cast"
+                FD_CLR(sd->s, &fdset);
+                #pragma GCC diagnostic pop
+            #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+                epoll_ctl (epoll_fd, EPOLL_CTL_DEL, sd->s, NULL);
+                if (sd->rx_pending) {
+                    ready.erase(std::find(ready.begin(), ready.end(), sd));
+                    sd->rx_pending = false;
+                }
+            #endif
+            // NOTE: Always the last socket, so nothing we haven't visited yet is moved into slot i.
+            detach_socket(sd);
+            if (hand_over(sd) == false)
+                break;
+        #endif
+        ++moved;
+    }
+
+    if (state.load() == Retiring) {
+        if (sockets.empty() && inbox.empty()) {
+            shedding.store(0);
+            state.store(Parked);
+            sys::log::NetworkEngine::add("<%s> retired, all connections handed over", name);
+        }
+    } else {
+        shedding.store(wanted - moved);
     }
 }
 
 
+/***
+ * Hands a detached connection over to the least loaded other recv-thread. If
+ * there is no other thread to take it we keep it, and stop shedding.
+ */
+bool NetworkEngineRecv::hand_over(SocketData* sd) {
+    if (NetworkEngine::instance().AssignConnection(sd, this) == true)
+        return true;
+
+    sys::log::NetworkEngine::warning("<%s> socket (%i): no other recv-thread to hand the connection over to, keeping it", name, sd->s);
+    shedding.store(0);
+    state.store(Active);
+
+    load++;
+    if (watch_socket(sd) == false) {
+        load--;
+        NetworkEngine::instance().DisconnectConnection(sd);
+    }
+    return false;
+}
+
+
+/***
+ * Queues the connection for this thread and wakes it up. Called by
+ * NetworkEngine::AssignConnection(), from any thread. A thread that is
+ * handing over its connections (or parked) refuses it, it would never poll
+ * it and none of the others would take it back.
+ */
+bool NetworkEngineRecv::assign(SocketData* sd) {
+    if (state.load() != Active)
+        return false;
+
+    load++;
+    if (inbox.push(sd) == false) {
+        load--;
+        return false;
+    }
+    wakeup();
+    return true;
+}
+
+
+void NetworkEngineRecv::shed(std::size_t n) {
+    shedding.store(n, std::memory_order_release);
+    wakeup();
+}
+
+
+void NetworkEngineRecv::retire(void) {
+    state.store(Retiring);
+    shedding.store(NetworkEngine::MaxSocketsPerThread, std::memory_order_release);
+    wakeup();
+}
+
+
+void NetworkEngineRecv::activate(void) {
+    int parked = Parked;
+    if (state.compare_exchange_strong(parked, Active))
+        sys::log::NetworkEngine::add("<%s> reactivated", name);
+}
+
+
+void NetworkEngineRecv::LogStatus(void) {
+    static const char* states[] = {"active", "retiring", "parked"};
+    sys::log::NetworkEngine::add(" <%s> %lu connection(s), %s, input throttled %lu time(s) (dropped %lu bytes, %lu lines)",
+            name, load.load(), states[state.load()], n_throttled.load(), n_dropped_bytes.load(), n_dropped_lines.load());
+}
+
+
 bool NetworkEngineRecv::read_data(SocketData* sd) {
     assert(sd != NULL);
     assert(sd->s != INVALID_SOCKET);
     assert(sd->cid != InvalidConnectionID);
 
-    char a[1024*64];
-    NetworkMessage* m = NULL;
+    // NOTE: Read into the pool's staging buffer, process_input() decodes it in place and then copies each
+    //       line into a buffer of the right size.
+    char* a = buffers.staging();
 
-    long int length = NetworkEngine::socket_read(sd->s, a, 1024*64);
+    std::chrono::steady_clock::time_point received;
+    long int length = NetworkEngine::socket_read(sd->s, a, read_allowance(sd, BufferPool::StagingSize), &received);
     if (length > 0) {
         sys::log::NetworkEngine::verbose("<%s> socket (%i): read %li bytes", name,  sd->s, length);
-        sd->rx += length;
-        char* tmpBuffer = new char[SIZE_MaxBufferSize];
-        memcpy(tmpBuffer, a, length);
-        m = NetworkMessage::construct(sd->cid, net::MessageTypes::DataIncoming, length, tmpBuffer);
-        GameEngine::instance().AddMessageRecv(m);
+        process_input(sd, a, static_cast<std::size_t>(length), received);
     } else if (length < 0) {
         sys::log::NetworkEngine::verbose("<%s> socket (%i): read FAILED (disconnecting)", name, sd->s);
         return false;
@@ -310,17 +566,524 @@ bool NetworkEngineRecv::read_data(SocketData* sd) {
 }
 
 
+#if (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+/***
+ * Edge-triggered version of read_data(). Reads until the socket would block,
+ * but no more than ReadBudgetPerWakeup bytes so a single connection pasting
+ * lots of data can't starve the others. If the budget runs out first the
+ * socket is put in the ready list, since no new edge will be reported for the
+ * input already waiting.
+ *
+ * NOTE: A read shorter than asked for means the socket buffer is empty, and
+ *       any input arriving later is a new edge, so we can skip the read that
+ *       would just return EAGAIN. Unless the peer has hung up, then we need to
+ *       read until EOF since there won't be any more events for the socket.
+ */
+bool NetworkEngineRecv::drain_data(SocketData* sd, bool hangup) {
+    assert(sd != NULL);
+    assert(sd->s != INVALID_SOCKET);
+    assert(!sd->rx_pending);
+
+    std::size_t budget = NetworkEngine::ReadBudgetPerWakeup;
+    while (budget > 0) {
+        char* a = buffers.staging();
+        std::size_t wanted = read_allowance(sd, (budget < BufferPool::StagingSize) ? budget : BufferPool::StagingSize);
+
+        std::chrono::steady_clock::time_point received;
+        long int length = NetworkEngine::socket_read(sd->s, a, wanted, &received);
+        if (length < 0) {
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): read FAILED (disconnecting)", name, sd->s);
+            return false;
+        }
+        if (length == 0)
+            return true;    // EAGAIN, drained.
+
+        sys::log::NetworkEngine::verbose("<%s> socket (%i): read %li bytes", name,  sd->s, length);
+        process_input(sd, a, static_cast<std::size_t>(length), received);
+        budget -= static_cast<std::size_t>(length);
+        if (sd->rx_paused)
+            return true;    // Over the input limits, the rest is read once resumed.
+
+        if (static_cast<std::size_t>(length) < wanted && !hangup)
+            return true;
+    }
+
+    sys::log::NetworkEngine::verbose("<%s> socket (%i): read budget used up, continuing later", name, sd->s);
+    sd->rx_pending = true;
+    ready.push_back(sd);
+    return true;
+}
+
+
+/***
+ * Gives the sockets that ran out of budget last time another turn. Sockets
+ * running out again are queued for the next pass.
+ */
+void NetworkEngineRecv::process_ready(void) {
+    std::vector<SocketData*> pending;
+    pending.swap(ready);
+
+    for (SocketData* sd: pending) {
+        sd->rx_pending = false;
+        // NOTE: We don't know if the peer has hung up in the meantime, so read until EAGAIN/EOF.
+        if (drain_data(sd, true) == false) {
+            epoll_ctl (epoll_fd, EPOLL_CTL_DEL, sd->s, NULL);
+            remove_socket(sd);
+        }
+    }
+
+    // Hand back the memory, so the ready list doesn't need to allocate next time.
+    if (ready.empty()) {
+        pending.clear();
+        ready.swap(pending);
+    }
+}
+#endif // (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+
+
+/***
+ * Runs data read from a socket through the connection's Telnet decoder, and
+ * hands each complete line over to the game as a DataIncoming message. Shared
+ * by all polling methods, regardless of if they read() themselves or get
+ * completions. The data is decoded in place, so it has to be ours to modify.
+ * received is when the data arrived, the messages carry it so the game can
+ * tell how long the input waited.
+ *
+ * The data is first counted against the connection's input limits. Without
+ * read pausing, data over the byte limit is dropped here, before decoding.
+ * With it, the reads are kept within the limit (see read_allowance()) and
+ * once a limit has run dry the connection is paused.
+ */
+void NetworkEngineRecv::process_input(SocketData* sd, char* data, std::size_t length, std::chrono::steady_clock::time_point received) {
+    assert(length > 0);
+
+    sd->rx += length;
+    if (NetworkEngine::use_input_limits) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        sd->rx_byte_limit.refill(now);
+        sd->rx_line_limit.refill(now);
+
+        if (!NetworkEngine::use_read_pausing) {
+            if (sd->rx_byte_limit.take(static_cast<double>(length)) == false) {
+                // NOTE: Whatever Telnet sequence or line this cuts through is garbled, but only for a
+                //       client sending far more than any player could.
+                ++n_throttled;
+                n_dropped_bytes += length;
+                return;
+            }
+        } else {
+            sd->rx_byte_limit.charge(static_cast<double>(length));
+        }
+    }
+
+    telnet_lines.clear();
+    telnet_events.clear();
+    sd->telnet.decode(data, length, telnet_lines, telnet_events);
+
+    for (const TelnetEvent& e: telnet_events) {
+        negotiate(sd, e);
+    }
+
+    for (const TelnetLine& l: telnet_lines) {
+        frame_line(sd, l, received);
+    }
+
+    if (NetworkEngine::use_input_limits && NetworkEngine::use_read_pausing && !sd->rx_paused &&
+        (sd->rx_byte_limit.available() < 1 || sd->rx_line_limit.available() < 1)) {
+        pause_reading(sd, std::chrono::steady_clock::now());
+    }
+}
+
+
+/***
+ * Hands a complete line over to the game, exactly one message per line. The
+ * start of a line cut off by the end of a read is kept in the connection's
+ * line buffer until the rest of it arrives, and that buffer then becomes the
+ * message data. A line complete in one read is copied out of the buffer it was
+ * read into, into one of its own size.
+ */
+void NetworkEngineRecv::frame_line(SocketData* sd, TelnetLine l, std::chrono::steady_clock::time_point received) {
+    assert(l.length > 0);
+    bool complete = (l.data[l.length - 1] == '\n');
+
+    if (sd->rx_overflow) {
+        // Still dropping the rest of a line that was too long.
+        if (complete)
+            sd->rx_overflow = false;
+        return;
+    }
+
+    std::size_t length = sd->rx_line_length + l.length;
+    if (length > NetworkEngine::MaxLineLength) {
+        line_overflow(sd);
+        sd->rx_overflow = !complete;
+        return;
+    }
+
+    if (complete && NetworkEngine::use_input_limits && sd->rx_line_limit.take(1) == false) {
+        // Over the line limit, dropped before anything is allocated for it.
+        ++n_dropped_lines;
+        BufferPool::release(sd->rx_line);
+        sd->rx_line = NULL;
+        sd->rx_line_length = 0;
+        return;
+    }
+
+    if (sd->rx_line == NULL) {
+        if (complete) {
+            char* tmpBuffer = buffers.claim(l.data, l.length);
+            NetworkMessage* m = NetworkMessage::construct(sd->cid, net::MessageTypes::DataIncoming, l.length, tmpBuffer);
+            m->received_at = received;
+            GameEngine::instance().AddMessageRecv(m);
+            return;
+        }
+        sd->rx_line = buffers.allocate(NetworkEngine::MaxLineLength);
+    }
+
+    memcpy(sd->rx_line + sd->rx_line_length, l.data, l.length);
+    sd->rx_line_length = length;
+    if (complete) {
+        // NOTE: A line is received when its end is, however long ago its start arrived.
+        NetworkMessage* m = NetworkMessage::construct(sd->cid, net::MessageTypes::DataIncoming, length, sd->rx_line);
+        m->received_at = received;
+        GameEngine::instance().AddMessageRecv(m);
+        sd->rx_line = NULL;
+        sd->rx_line_length = 0;
+    }
+}
+
+
+/***
+ * Caps a read at what is left of the connection's byte limit, so with read
+ * pausing we never read more than the limit allows.
+ */
+std::size_t NetworkEngineRecv::read_allowance(SocketData* sd, std::size_t wanted) {
+    if (!NetworkEngine::use_input_limits || !NetworkEngine::use_read_pausing)
+        return wanted;
+
+    double available = sd->rx_byte_limit.available();
+    if (available < 1)
+        return 1;   // NOTE: Only if the connection was never paused, process_input() takes care of that.
+    return (available < static_cast<double>(wanted)) ? static_cast<std::size_t>(available) : wanted;
+}
+
+
+/***
+ * Stops polling the connection until its input limits have refilled enough
+ * for another line and a tenth of a second's worth of bytes, see
+ * resume_reading(). Its input waits in the socket's buffer meanwhile. With
+ * io_uring the multishot recv is cancelled, and process_completions() only
+ * puts the connection in the paused list once its last completion arrives.
+ */
+void NetworkEngineRecv::pause_reading(SocketData* sd, std::chrono::steady_clock::time_point now) {
+    // NOTE: Waiting for more than a single byte, or a flooding connection would be paused and resumed
+    //       again for every few bytes.
+    std::chrono::steady_clock::duration wait = sd->rx_byte_limit.until(NetworkEngine::InputBytesPerSecond / 10.0);
+    if (sd->rx_line_limit.until(1) > wait)
+        wait = sd->rx_line_limit.until(1);
+
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wold-style-cast"
+        FD_CLR(sd->s, &fdset);
+        #pragma GCC diagnostic pop
+        paused.push_back(sd);
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+        epoll_ctl (epoll_fd, EPOLL_CTL_DEL, sd->s, NULL);
+        paused.push_back(sd);
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        // Already being cancelled to be handed over, the new thread will notice soon enough.
+        if (sd->rx_migrating || ring.prepare_cancel(reinterpret_cast<uint64_t>(sd)) == false)
+            return;
+    #endif
+
+    sd->rx_paused = true;
+    sd->rx_resume_at = now + wait;
+    ++n_throttled;
+    sys::log::NetworkEngine::verbose("<%s> socket (%i): input over the limits, paused for %li ms", name, sd->s,
+            static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(wait).count()));
+}
+
+
+/***
+ * Starts polling the paused connections again whose limits have refilled.
+ */
+void NetworkEngineRecv::resume_reading(void) {
+    if (paused.empty())
+        return;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::size_t i = 0;
+    while (i < paused.size()) {
+        SocketData* sd = paused[i];
+        if (sd->rx_resume_at > now) {
+            ++i;
+            continue;
+        }
+
+        paused[i] = paused.back();
+        paused.pop_back();
+        sd->rx_paused = false;
+        sys::log::NetworkEngine::verbose("<%s> socket (%i): input resumed", name, sd->s);
+        if (arm_socket(sd) == false)
+            remove_socket(sd);
+    }
+}
+
+
+/***
+ * Returns how long (ms) to wait for input at most, timeout or less if a paused
+ * connection is to be resumed before that.
+ */
+int NetworkEngineRecv::resume_timeout(int timeout) {
+    if (paused.empty())
+        return timeout;
+
+    std::chrono::steady_clock::time_point first = paused[0]->rx_resume_at;
+    for (SocketData* sd: paused) {
+        if (sd->rx_resume_at < first)
+            first = sd->rx_resume_at;
+    }
+
+    // NOTE: Rounded up, so we don't wake up just before it's time and spin until it is.
+    std::chrono::steady_clock::duration left = first - std::chrono::steady_clock::now();
+    long ms = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(left).count()) + 1;
+    if (ms < 0)
+        return 0;
+    return (ms < timeout) ? static_cast<int>(ms) : timeout;
+}
+
+
+/***
+ * Drops the line being framed, and lets the client know.
+ */
+void NetworkEngineRecv::line_overflow(SocketData* sd) {
+    sys::log::NetworkEngine::debug("<%s> socket (%i): line longer than %lu bytes dropped", name, sd->s, NetworkEngine::MaxLineLength);
+
+    BufferPool::release(sd->rx_line);
+    sd->rx_line = NULL;
+    sd->rx_line_length = 0;
+    NetworkEngine::instance().SendData(sd->cid, MSG_BufferOverFlow, sizeof(MSG_BufferOverFlow) - 1);
+}
+
+
+/***
+ * Answers the client's option negotiation. The only option we support is
+ * MCCP2, which we offer every new connection, so a DO for it starts the
+ * compression. All other options the client asks for or offers are refused.
+ * WONT and DONT already agree with our state and must not be answered
+ * (RFC 854), or we'd end up in a negotiation loop.
+ */
+void NetworkEngineRecv::negotiate(SocketData* sd, TelnetEvent e) {
+    char reply[3] = {static_cast<char>(telnet::IAC), 0, static_cast<char>(e.option)};
+
+    switch (e.command) {
+    case telnet::DO:
+        if (e.option == telnet::COMPRESS2 && NetworkEngine::use_mccp2) {
+            // NOTE: Compression can't be restarted once started, so any later DO is just ignored.
+            if (!sd->rx_mccp) {
+                sys::log::NetworkEngine::debug("<%s> socket (%i): telnet option %u (MCCP2) accepted", name, sd->s, e.option);
+                sd->rx_mccp = true;
+                NetworkEngine::instance().StartCompression(sd->cid);
+            }
+            return;
+        }
+        reply[1] = static_cast<char>(telnet::WONT);
+        break;
+    case telnet::WILL:
+        reply[1] = static_cast<char>(telnet::DONT);
+        break;
+    default:
+        sys::log::NetworkEngine::verbose("<%s> socket (%i): telnet command %u (option %u) ignored", name, sd->s, e.command, e.option);
+        return;
+    }
+
+    sys::log::NetworkEngine::debug("<%s> socket (%i): telnet option %u refused", name, sd->s, e.option);
+    NetworkEngine::instance().SendData(sd->cid, reply, sizeof(reply));
+}
+
+
+#if (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+/***
+ * Processes all available completions in one batch. Each completion either
+ * carries data in a provided buffer, which is handed back to the kernel after
+ * processing, or is the last one of a multishot recv that has terminated.
+ */
+void NetworkEngineRecv::process_completions(void) {
+    unsigned int ready = ring.cq_ready();
+    unsigned int nData = 0;
+
+    // NOTE: Provided buffer recvs carry no control data, so no kernel timestamps. The data is taken to have
+    //       arrived when we got the completions.
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < ready; i++) {
+        struct io_uring_cqe* cqe = ring.peek_cqe(i);
+        if (cqe->user_data == reinterpret_cast<uint64_t>(&control)) {
+            control_clear();
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+                ring.prepare_poll_multishot(control, reinterpret_cast<uint64_t>(&control));
+            continue;
+        }
+
+        SocketData* sd = reinterpret_cast<SocketData*>(cqe->user_data);
+        if (sd == NULL)
+            continue;   // Completion for a cancel request.
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe->res > 0) {
+                NetworkStats::local().read(static_cast<std::size_t>(cqe->res));
+                process_input(sd, ring.buffer(bid), static_cast<std::size_t>(cqe->res), received);
+                ++nData;
+            }
+            ring.buffer_recycle(bid);
+        }
+
+        if (cqe->flags & IORING_CQE_F_MORE)
+            continue;
+
+        // The multishot recv terminated. If we cancelled it to pause reading, the connection now waits to
+        // be resumed, and if we cancelled it to hand the connection over, do so now.
+        if (sd->rx_paused && (cqe->res == -ECANCELED || cqe->res == -ENOBUFS)) {
+            paused.push_back(sd);
+            continue;
+        }
+        if (sd->rx_migrating && (cqe->res == -ECANCELED || cqe->res == -ENOBUFS)) {
+            sd->rx_migrating = false;
+            detach_socket(sd);
+            hand_over(sd);
+            continue;
+        }
+
+        // Running out of provided buffers is transient, so just re-arm, but anything else (EOF, errors,
+        // cancellation) means the socket is done.
+        if (cqe->res == -ENOBUFS) {
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): out of provided buffers, re-arming", name, sd->s);
+            if (ring.prepare_recv_multishot(sd->s, reinterpret_cast<uint64_t>(sd)) == true)
+                continue;
+        }
+        if (cqe->res < 0 && cqe->res != -ECANCELED) {
+            sys::log::NetworkEngine::error("<%s> socket (%i): ERROR (%i:%s)", name, sd->s, -cqe->res, NetworkEngine::get_error_msg(-cqe->res));
+        } else if (cqe->res == 0) {
+            sys::log::NetworkEngine::debug("socket (%i): EOF (connection broken by peer)", sd->s);
+        }
+        sys::log::NetworkEngine::verbose("<%s> socket (%i): removing", name, sd->s);
+        remove_socket(sd);
+    }
+
+    ring.cq_advance(ready);
+    ring.buffer_commit();
+    sys::log::NetworkEngine::verbose("<%s> %lu connection(s) - processed %u completion(s), %u with data", name, sockets.size(), ready, nData);
+}
+
+
+#endif // (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+
+
+void NetworkEngineRecv::add_socket(SocketData* sd) {
+    sd->slot = sockets.size();
+    sockets.push_back(sd);
+}
+
+
+/***
+ * Disconnects the connection and removes it from the list of sockets.
+ */
+void NetworkEngineRecv::remove_socket(SocketData* sd) {
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_EPOLL)
+        if (sd->rx_pending)
+            ready.erase(std::find(ready.begin(), ready.end(), sd));
+    #endif
+    if (sd->rx_paused) {
+        // NOTE: With io_uring it's only in the list once its recv has been cancelled.
+        std::vector<SocketData*>::iterator it = std::find(paused.begin(), paused.end(), sd);
+        if (it != paused.end())
+            paused.erase(it);
+    }
+
+    // NOTE: Once disconnected the send-thread may release sd at any time, so we are done with it after this.
+    if (detach_socket(sd))
+        NetworkEngine::instance().DisconnectConnection(sd);
+}
+
+
+/***
+ * Removes the connection from the list of sockets, without disconnecting it.
+ * Like UnorderedArray::remove() the last socket is moved into the freed slot,
+ * so the order of the list is not preserved.
+ */
+bool NetworkEngineRecv::detach_socket(SocketData* sd) {
+    std::size_t slot = sd->slot;
+    if (slot >= sockets.size() || sockets[slot] != sd) {
+        sys::log::NetworkEngine::error("<%s> socket (%i): not found in connection list.", name, sd->s);
+        return false;
+    }
+
+    SocketData* last = sockets.back();
+    sockets.pop_back();
+    if (last != sd) {
+        sockets[slot] = last;
+        last->slot = slot;
+    }
+    load--;
+    return true;
+}
+
+
+void NetworkEngineRecv::record_wakeup(std::size_t nSockets, std::size_t nEvents, std::chrono::steady_clock::duration elapsed) {
+    NetworkStats::local().woke(nEvents);
+
+    std::size_t bucket = 0;
+    while ((nSockets >> (bucket + 1)) > 0 && bucket < WakeupBuckets - 1)
+        ++bucket;
+
+    wakeup_stats[bucket].wakeups++;
+    wakeup_stats[bucket].events += nEvents;
+    wakeup_stats[bucket].ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+
+/***
+ * Logs the average cost of processing a wakeup against the number of
+ * connections the thread had at the time. With O(1) dispatch the cost per
+ * event should stay flat as the number of connections grows.
+ */
+void NetworkEngineRecv::log_wakeups(void) {
+    for (std::size_t i = 0; i < WakeupBuckets; i++) {
+        const WakeupStats& ws = wakeup_stats[i];
+        if (ws.wakeups == 0)
+            continue;
+        sys::log::NetworkEngine::add("<%s> %lu-%lu connection(s): %lu wakeup(s), %.1f events/wakeup, %lu ns/wakeup, %lu ns/event",
+                name, std::size_t(1) << i, (std::size_t(2) << i) - 1, ws.wakeups,
+                static_cast<double>(ws.events) / ws.wakeups, ws.ns / ws.wakeups, (ws.events > 0) ? ws.ns / ws.events : 0);
+    }
+}
+
+
 void NetworkEngineRecv::purge_select_set(void) {
     #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
 
     sys::log::NetworkEngine::debug("<%s> purge_select_set() - rebuilding fd_set...", name);
 
+    // NOTE: Paused connections stay out of the set, resume_reading() puts them back with arm_socket().
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wold-style-cast"
     FD_ZERO(&fdset);
+    socket_max = -1;
+    if (control != INVALID_SOCKET) {
+        FD_SET(control, &fdset);
+        socket_max = control + 1;
+    }
     std::vector<SocketData*>::iterator it = sockets.begin();
     while (it != sockets.end()) {
-        FD_SET((*it)->s, &fdset);
+        if ((*it)->rx_paused == false) {
+            FD_SET((*it)->s, &fdset);
+            socket_max = std::max(socket_max, (*it)->s + 1);
+        }
         ++it;
     }
+    #pragma GCC diagnostic pop
 
     #endif
 }
@@ -3,9 +3,14 @@
 
 #include "NetworkEngineThread.h"   //
 #include "NetworkCore.h"
+#include "NetworkUring.h"
+#include "NetworkBuffer.h"
+#include "NetworkTelnet.h"
 
+#include <atomic>           // std::atomic<T>
 #include <mutex>            // std::mutex
 #include <vector>           // std::vector
+#include <chrono>           // std::chrono::steady_clock
 
 
 namespace net {
@@ -18,18 +23,74 @@ public:
 
     bool run(void);
 
+    // Load balancing between the recv-threads, see NetworkEngine::AssignConnection() and BalanceRecvThreads().
+    // NOTE: Can all be called from any thread.
+    enum State {Active, Retiring, Parked};
+    State       GetState(void) {return static_cast<State>(state.load());}
+    std::size_t GetLoad(void) {return load.load(std::memory_order_relaxed);}
+
+    bool assign(SocketData* sd);    // Queues a new (or migrating) connection for the thread.
+    void shed(std::size_t n);       // Hand over n connections to other threads.
+    void retire(void);              // Hand over all connections to other threads, then stay parked.
+    void activate(void);            // Take connections again, after being parked.
+
+    void LogStatus(void);
+
 private:
     NetworkEngineRecv(const NetworkEngineRecv&);
     NetworkEngineRecv& operator=(const NetworkEngineRecv&);
 
     void exec(void);
     void fetch_new_connections(void);
+    bool watch_socket(SocketData* sd);
+    bool arm_socket(SocketData* sd);
+    void migrate_connections(void);
+    bool hand_over(SocketData* sd);
     bool read_data(SocketData* sd);
+    bool drain_data(SocketData* sd, bool hangup);
+    void process_input(SocketData* sd, char* data, std::size_t length, std::chrono::steady_clock::time_point received);
+    void negotiate(SocketData* sd, TelnetEvent e);
+    void frame_line(SocketData* sd, TelnetLine l, std::chrono::steady_clock::time_point received);
+    void line_overflow(SocketData* sd);
+    std::size_t read_allowance(SocketData* sd, std::size_t wanted);
+    void pause_reading(SocketData* sd, std::chrono::steady_clock::time_point now);
+    void resume_reading(void);
+    int  resume_timeout(int timeout);
+    void add_socket(SocketData* sd);
+    void remove_socket(SocketData* sd);
+    bool detach_socket(SocketData* sd);
+    void record_wakeup(std::size_t nSockets, std::size_t nEvents, std::chrono::steady_clock::duration elapsed);
+    void log_wakeups(void);
 
     void purge_select_set(void);
 
     std::mutex mutex_data;
     std::vector<SocketData*> sockets;
+    BufferPool buffers;     // Owns the data of all DataIncoming messages sent from this thread.
+
+    // Output of the Telnet decoder, reused for every read.
+    std::vector<TelnetLine>  telnet_lines;
+    std::vector<TelnetEvent> telnet_events;
+
+    std::vector<SocketData*> paused;    // Connections over their input limits, not polled for now.
+
+    // Input throttled by the limits, see NetworkEngine::use_input_limits.
+    std::atomic<uint64_t> n_throttled;      // Connections paused, or reads dropped without read pausing.
+    std::atomic<uint64_t> n_dropped_bytes;
+    std::atomic<uint64_t> n_dropped_lines;
+
+    SocketQueue              inbox;     // Connections assigned to the thread, not yet polled.
+    std::atomic<std::size_t> load;      // Connections polled or in the inbox.
+    std::atomic<int>         state;
+    std::atomic<std::size_t> shedding;  // Connections still to hand over.
+
+    // Cost of processing a wakeup, bucketed by the number of connections (bucket i holds 2^i to 2^(i+1)-1).
+    static const std::size_t WakeupBuckets = 16;
+    struct WakeupStats {
+        uint64_t wakeups;
+        uint64_t events;
+        uint64_t ns;
+    } wakeup_stats[WakeupBuckets];
 
     #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
         fd_set fdset;
@@ -38,6 +99,13 @@ private:
         int epoll_fd;
         struct epoll_event event;
         struct epoll_event *events;
+        std::vector<SocketData*> ready;     // Edge-triggered: sockets left with input when their budget ran out.
+
+        void process_ready(void);
+    #elif (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+        void process_completions(void);
+
+        NetworkUring ring;
     #endif
 };
 
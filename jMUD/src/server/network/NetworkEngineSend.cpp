@@ -1,13 +1,29 @@
 #include <functional>
+#include <algorithm>          // std::find()
 
 #include "NetworkEngineSend.h"
 #include "NetworkEngine.h"
+#include "../ThreadPlacement.h"
+
+#if (PLATFORM == PLATFORM_UNIX)
+    #include <sys/uio.h>        // struct iovec
+#endif
 
 
 namespace net {
 
 
-NetworkEngineSend::NetworkEngineSend(const char* n) {
+NetworkEngineSend::NetworkEngineSend(const char* n) :
+    pending(),
+    zpool(NetworkEngine::CompressionLevel, NetworkEngine::CompressionWindowBits, NetworkEngine::CompressionMemLevel, NetworkEngine::MaxPooledCompressors),
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        blocked()
+    #else
+        epoll_fd(-1),
+        events(NULL),
+        n_blocked(0)
+    #endif
+{
     // Allocate memory and copy the name of the thread.
     if (n == NULL) {
         sys::log::NetworkEngine::warning("NetworkEngineSend will be unnamed.");
@@ -21,6 +37,32 @@ NetworkEngineSend::NetworkEngineSend(const char* n) {
         strcpy(name, n);
     }
 
+    if (control_open() == false) {
+        sys::log::NetworkEngine::warning("<%s> Failed to create an eventfd, output will only be noticed every poll. (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+    }
+
+    #if (NETWORK_POLLING != NETWORK_POLLING_USE_SELECT)
+        // NOTE: Sockets are only added while their output is blocked, waiting for them to become writable.
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd == -1) {
+            sys::log::NetworkEngine::error("<%s> Failed to create an epoll file descriptor. Aborting. (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            return;
+        }
+        events = new epoll_event[NetworkEngine::MaxSocketsPerThread];
+
+        // NOTE: control is told apart from the sockets by its data.ptr pointing at it, not a SocketData.
+        if (control != INVALID_SOCKET) {
+            struct epoll_event event;
+            event.data.ptr = &control;
+            event.events = EPOLLIN;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control, &event) == -1) {
+                sys::log::NetworkEngine::error("<%s> epoll_ctl(): adding eventfd (%i) - FAILED (%i:%s)", name, control, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                control_close();
+            }
+        }
+    #endif
+
+    pending.reserve(NetworkEngine::MaxSocketsPerThread);
     initialized = true;
 
     sys::log::NetworkEngine::debug("NetworkEngineSend <%s> created", name);
@@ -28,6 +70,12 @@ NetworkEngineSend::NetworkEngineSend(const char* n) {
 
 
 NetworkEngineSend::~NetworkEngineSend() {
+    #if (NETWORK_POLLING != NETWORK_POLLING_USE_SELECT)
+        if (epoll_fd != -1)
+            ::close(epoll_fd);
+        delete[] events;
+    #endif
+
     delete[] name;
     delete t;
 }
@@ -57,43 +105,458 @@ bool NetworkEngineSend::run() {
 }
 
 
+/***
+ * Each pass closes removed connections, moves queued output onto the output
+ * queues of the connections, writes as much as possible of it and finally
+ * waits for blocked connections to become writable again, or to be woken up
+ * by more output or removed connections being queued. When shutting down it
+ * reports once all output has been written, and closes all connections left
+ * before terminating.
+ */
 void NetworkEngineSend::exec(void) {
     sys::log::NetworkEngine::add("<%s> Starting...", name);
+    ThreadPlacement::instance().place(ThreadPlacement::Send, name);
 
-    // FIXME: Move this time specification into the NetworkEngine class, and make it run-time configurable.
-    //        Track uqueue_remove_size_peek, if we ever get close to it this delay should be reduced and
-    //        perhaps we should even add some automatic scaling of it... Say if we remove a connection then
-    //        the next delay is shorter, but after a few times of nothing to remove we go back to a longer
-    //        delay.
-    struct timespec req = { 0, 750 * 1000 * 1000}; // 250 milliseconds
-    struct timespec rem = { 0, 0};
-
+    running = true;
     while (!NetworkEngine::instance().terminate()) {
-        if (!NetworkEngine::instance().uqueue_remove.empty()) {
-            sys::log::NetworkEngine::debug("<%s> fetching removed connections...", name);
-            NetworkEngine::instance().uqueue_remove.lock();
-
-            std::size_t size_old = NetworkEngine::instance().uqueue_remove.size();
-            while (!NetworkEngine::instance().uqueue_remove.empty()) {
-                SocketData* sd = NetworkEngine::instance().uqueue_remove.pop();
-
-//                sys::log::NetworkEngine::add("   socket (%i): disconnected (cid = %u, RX = %lu KiB, TX = %lu KiB)", sd->s, sd->cid, sd->rx / 1024, sd->tx / 1024);
-                sys::log::NetworkEngine::add("   socket (%i): disconnected (cid = %u, RX = %lu bytes, TX = %lu bytes)",
-                           sd->s, sd->cid, sd->rx, sd->tx);
-                NetworkEngine::socket_close(sd->s);
-                SocketData::destruct(sd);
+        // NOTE: From here on anything queued for us wakes us up through control.
+        wait_begin();
+
+        remove_connections();
+        fetch_messages();
+
+        for (SocketData* sd: pending) {
+            flush(sd);
+        }
+        pending.clear();
+
+        // NOTE: The final output was all queued before draining was set, so once that's seen and all of it
+        //       written there is nothing more to wait for.
+        if (NetworkEngine::instance().draining() && all_written())
+            NetworkEngine::instance()._drained.store(true, std::memory_order_release);
+
+        #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+
+            // FIXME: Remove that "magic" value for the timeout time.
+            control_wait(blocked.empty() ? 500 : NetworkEngine::SendPollTimeout);
+            wait_end();
+
+            // Without a poll set of our own, just try again on all blocked connections.
+            std::vector<SocketData*> retry;
+            retry.swap(blocked);
+            for (SocketData* sd: retry) {
+                sd->out_blocked = false;
+                flush(sd);
+            }
+
+        #else
+
+            // FIXME: Remove that "magic" value for the timeout time.
+            int timeout = (control != INVALID_SOCKET) ? 500 : NetworkEngine::SendPollTimeout;
+            int eventCount = epoll_wait(epoll_fd, events, NetworkEngine::MaxSocketsPerThread, timeout);
+            wait_end();
+            if (eventCount == -1) {
+                if (NetworkEngine::get_error_code() == EINTR)
+                    continue;
+                sys::log::NetworkEngine::debug("<%s> epoll_wait() - FAILED (%i:%s)", name, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+                break;
             }
-            NetworkEngine::instance().uqueue_remove.unlock();
-            sys::log::NetworkEngine::debug("<%s> %lu connection(s) removed", name, size_old - NetworkEngine::instance().uqueue_remove.size());
 
+            for (int i = 0; i < eventCount; i++) {
+                if (events[i].data.ptr == &control) {
+                    control_clear();
+                    continue;
+                }
+
+                SocketData* sd = static_cast<SocketData*>(events[i].data.ptr);
+                sd->out_blocked = false;
+                --n_blocked;
+
+                // The connection is broken, the recv-thread will notice and disconnect it.
+                if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP)) {
+                    sys::log::NetworkEngine::verbose("<%s> socket (%i): broken, dropping %lu bytes of output", name, sd->s, sd->out_queued);
+                    drop_output(sd);
+                    continue;
+                }
+
+                sys::log::NetworkEngine::verbose("<%s> socket (%i): writable again", name, sd->s);
+                flush(sd);
+            }
+
+        #endif
+    }
+
+    remove_connections();
+    close_connections();
+    sys::log::NetworkEngine::add("<%s> Terminating.", name);
+}
+
+
+/***
+ * Closes the sockets of all connections the recv-threads have removed and
+ * releases their SocketData. Any output still queued is dropped.
+ */
+void NetworkEngineSend::remove_connections(void) {
+    SocketData* removed[64];
+    std::size_t nRemoved = 0;
+
+    std::size_t n;
+    while ((n = NetworkEngine::instance().uqueue_remove.pop(removed, sizeof(removed) / sizeof(removed[0]))) > 0) {
+        for (std::size_t i = 0; i < n; i++) {
+            SocketData* sd = removed[i];
+
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): closing (cid = %u, RX = %lu bytes, TX = %lu bytes, %lu bytes dropped)",
+                    name, sd->s, sd->cid, sd->rx, sd->tx, sd->out_queued);
+            drop_output(sd);
+            zpool.release(sd->out_zstream);
+            sd->out_zstream = NULL;
+
+            #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+                if (sd->out_blocked)
+                    blocked.erase(std::find(blocked.begin(), blocked.end(), sd));
+            #else
+                if (sd->out_blocked)
+                    --n_blocked;
+                if (sd->out_watched)
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sd->s, NULL);
+            #endif
+
+            NetworkEngine::socket_close(sd->s);
+            SocketData::destruct(sd);
         }
-        sys::log::NetworkEngine::verbose("<%s> sleeping (max %lis %lims %lius %lins)", name, req.tv_sec, req.tv_nsec / 1000000, (req.tv_nsec % 1000000) / 1000, req.tv_nsec % 1000);
-        nanosleep(&req, &rem);
+        nRemoved += n;
     }
 
-    // TODO: Trigger a logging of all statistics NetworkEngine has, since we are closing down.
+    if (nRemoved > 0)
+        sys::log::NetworkEngine::debug("<%s> %lu connection(s) removed", name, nRemoved);
+}
+
 
-    sys::log::NetworkEngine::add("<%s> Terminating.", name);
+/***
+ * Closes all connections left when terminating, the recv-threads are gone by
+ * then. Output that didn't make it out in time is dropped. Any unread input is
+ * read and thrown away first, closing a socket with input unread resets the
+ * connection, which could lose output the client hasn't received yet.
+ */
+void NetworkEngineSend::close_connections(void) {
+    std::vector<ConnectionID> cids;
+    SocketTable::instance().connections(cids);
+
+    std::size_t nClosed = 0;
+    std::size_t nCutOff = 0;
+    std::size_t unsent = 0;
+    char discard[4096];
+    for (ConnectionID cid: cids) {
+        SocketData* sd = NetworkEngine::instance().GetSocketData(cid);
+        if (sd == NULL)
+            continue;
+
+        if (sd->out_queued > 0) {
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): cut off, dropping %lu bytes of output", name, sd->s, sd->out_queued);
+            ++nCutOff;
+            unsent += sd->out_queued;
+        }
+        drop_output(sd);
+        zpool.release(sd->out_zstream);
+        sd->out_zstream = NULL;
+
+        for (int i = 0; i < 16 && NetworkEngine::socket_read(sd->s, discard, sizeof(discard)) > 0; i++) {}
+
+        sys::log::NetworkEngine::add("socket (%i): disconnected (cid = %u, RX = %lu KiB, TX = %lu KiB)",
+                sd->s, sd->cid, sd->rx/1024, sd->tx/1024);
+        NetworkEngine::instance().users_current--;
+        NetworkEngine::socket_close(sd->s);
+        SocketData::destruct(sd);
+        ++nClosed;
+    }
+
+    sys::log::NetworkEngine::add("<%s> %lu connection(s) closed, %lu of them cut off with %lu bytes of output unsent",
+            name, nClosed, nCutOff, unsent);
+}
+
+
+/***
+ * Moves all queued messages onto the output queues of their connections, and
+ * marks the connections that need flushing.
+ */
+void NetworkEngineSend::fetch_messages(void) {
+    NetworkMessage* messages[256];
+
+    std::size_t n;
+    while ((n = NetworkEngine::instance().messagesToSend.pop(messages, sizeof(messages) / sizeof(messages[0]))) > 0) {
+        for (std::size_t i = 0; i < n; i++) {
+            NetworkMessage* m = messages[i];
+
+            if (m->type != net::MessageTypes::DataOutgoing && m->type != net::MessageTypes::CompressStart &&
+                    m->type != net::MessageTypes::CloseConnection) {
+                sys::log::NetworkEngine::error("<%s> Received a NetworkMessage with type=%i to send. Should never happen.", name, m->type);
+                NetworkMessage::destruct(m);
+                continue;
+            }
+
+            // NOTE: Since we are the only ones releasing SocketData, it stays valid for the whole pass.
+            SocketData* sd = NetworkEngine::instance().GetSocketData(m->cid);
+            if (sd == NULL) {
+                sys::log::NetworkEngine::verbose("<%s> dropping %lu bytes of output for closed connection (cid = %u)", name, m->size, m->cid);
+                NetworkMessage::destruct(m);
+                continue;
+            }
+
+            // NOTE: Output queued after the close is dropped, the connection is going away.
+            if (m->type == net::MessageTypes::CloseConnection || sd->out_close) {
+                if (m->type == net::MessageTypes::CloseConnection)
+                    close_output(sd);
+                NetworkMessage::destruct(m);
+                continue;
+            }
+
+            if (sd->out_queued + m->size > NetworkEngine::MaxOutputPerConnection) {
+                sys::log::NetworkEngine::warning("<%s> socket (%i): more than %lu bytes of output queued, disconnecting (cid = %u)",
+                        name, sd->s, NetworkEngine::MaxOutputPerConnection, sd->cid);
+                NetworkMessage::destruct(m);
+                drop_output(sd);
+                NetworkEngine::socket_shutdown(sd->s);
+                continue;
+            }
+
+            if (sd->out_zstream != NULL) {
+                // NOTE: Only deflated for now, flush() ends the block so the client can decompress it.
+                compress_output(sd, m->data, m->size, Z_NO_FLUSH);
+                NetworkMessage::destruct(m);
+                continue;
+            }
+
+            // NOTE: The start sequence itself goes out uncompressed, everything after it is compressed.
+            if (m->type == net::MessageTypes::CompressStart && start_compression(sd) == false) {
+                NetworkMessage::destruct(m);
+                continue;
+            }
+            queue_output(sd, m);
+        }
+    }
+}
+
+
+/***
+ * Adds the message to the end of the connection's output queue.
+ */
+void NetworkEngineSend::queue_output(SocketData* sd, NetworkMessage* m) {
+    bool idle = (sd->out_head == NULL);
+    if (idle) {
+        sd->out_head = m;
+    } else {
+        sd->out_tail->next = m;
+    }
+    sd->out_tail = m;
+    sd->out_queued += m->size;
+
+    if (idle && !sd->out_blocked)
+        pending.push_back(sd);
+}
+
+
+/***
+ * Shuts the connection down once all output queued for it has been written,
+ * right away if there is none.
+ */
+void NetworkEngineSend::close_output(SocketData* sd) {
+    if (sd->out_close)
+        return;
+
+    sd->out_close = true;
+    sys::log::NetworkEngine::debug("<%s> socket (%i): closed by the game, %lu bytes of output left (cid = %u)", name, sd->s, sd->out_queued, sd->cid);
+    if (sd->out_head == NULL)
+        NetworkEngine::socket_shutdown(sd->s);
+}
+
+
+/***
+ * Takes a deflate stream from the pool for the connection. If there is none
+ * to be had the connection stays uncompressed, the client only expects
+ * compressed output after the start sequence and that is dropped then.
+ */
+bool NetworkEngineSend::start_compression(SocketData* sd) {
+    if (sd->out_zstream != NULL)
+        return false;
+
+    sd->out_zstream = zpool.acquire();
+    if (sd->out_zstream == NULL) {
+        sys::log::NetworkEngine::warning("<%s> socket (%i): no deflate stream available, output stays uncompressed (cid = %u)", name, sd->s, sd->cid);
+        return false;
+    }
+    sys::log::NetworkEngine::debug("<%s> socket (%i): MCCP2 started (%lu streams in use, %lu free)", name, sd->s, zpool.InUse(), zpool.Free());
+    return true;
+}
+
+
+/***
+ * Deflates the data onto the end of the connection's output queue. The
+ * compressed output goes into chunks of CompressionChunkSize bytes, queued as
+ * messages of their own and filled up as more output is compressed. mode is
+ * Z_NO_FLUSH to just add data, or Z_SYNC_FLUSH to make everything given so
+ * far decompressable by the client.
+ */
+void NetworkEngineSend::compress_output(SocketData* sd, const char* data, std::size_t length, int mode) {
+    z_stream* z = sd->out_zstream;
+    z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    z->avail_in = static_cast<uInt>(length);
+    sd->out_zpending = (mode == Z_NO_FLUSH);
+    std::size_t total = 0;
+
+    do {
+        if (sd->out_zroom == 0) {
+            char* buffer = BufferPool::allocate_unpooled(NetworkEngine::CompressionChunkSize);
+            NetworkMessage* chunk = NetworkMessage::construct(sd->cid, net::MessageTypes::DataOutgoing, NetworkEngine::CompressionChunkSize, buffer);
+            chunk->size = 0;    // Grows as deflate() writes to it.
+            queue_output(sd, chunk);
+            sd->out_zchunk = chunk;
+            sd->out_zroom = NetworkEngine::CompressionChunkSize;
+        }
+
+        z->next_out = reinterpret_cast<Bytef*>(sd->out_zchunk->data + sd->out_zchunk->size);
+        z->avail_out = static_cast<uInt>(sd->out_zroom);
+        deflate(z, mode);
+
+        std::size_t produced = sd->out_zroom - z->avail_out;
+        sd->out_zchunk->size += produced;
+        sd->out_zroom -= produced;
+        sd->out_queued += produced;
+        total += produced;
+    } while (z->avail_in > 0 || sd->out_zroom == 0);
+    NetworkStats::local().deflated(length, total);
+}
+
+
+/***
+ * Writes as much of the output queued for the connection as the socket will
+ * take, gathering up to SendMaxFragments messages into each write. The game
+ * queues its output once per tick, so usually that is a single write for all
+ * of it. If it takes more than one write the socket is corked meanwhile, so
+ * the writes don't each end in a small packet (the sockets have nodelay set).
+ * If the socket can't take it all, the connection waits for it to become
+ * writable.
+ */
+void NetworkEngineSend::flush(SocketData* sd) {
+    assert(sd != NULL);
+    assert(!sd->out_blocked);
+
+    if (sd->out_zpending)
+        compress_output(sd, NULL, 0, Z_SYNC_FLUSH);
+
+    bool corked = false;
+    while (sd->out_head != NULL) {
+        struct iovec iov[NetworkEngine::SendMaxFragments];
+        int count = 0;
+        std::size_t total = 0;
+
+        NetworkMessage* m = sd->out_head;
+        for (; m != NULL && count < NetworkEngine::SendMaxFragments; m = m->next) {
+            std::size_t skip = (count == 0) ? sd->out_offset : 0;
+            iov[count].iov_base = m->data + skip;
+            iov[count].iov_len = m->size - skip;
+            total += iov[count].iov_len;
+            ++count;
+        }
+        if (m != NULL && !corked)
+            corked = NetworkEngine::socket_mode_cork(sd->s, true);
+
+        long result = NetworkEngine::socket_sendv(sd->s, iov, count);
+        if (result < 0) {
+            // The recv-thread will notice the broken connection and disconnect it.
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): write FAILED, dropping %lu bytes of output", name, sd->s, sd->out_queued);
+            drop_output(sd);
+            NetworkEngine::socket_shutdown(sd->s);
+            return;
+        }
+
+        sd->tx += result;
+        sd->out_queued -= result;
+
+        // Release everything that was completely sent, and remember how far into the next message we got.
+        std::size_t sent = sd->out_offset + result;
+        while (sd->out_head != NULL && sent >= sd->out_head->size) {
+            m = sd->out_head;
+            sent -= m->size;
+            sd->out_head = m->next;
+            if (m == sd->out_zchunk) {
+                sd->out_zchunk = NULL;
+                sd->out_zroom = 0;
+            }
+            NetworkMessage::destruct(m);
+        }
+        sd->out_offset = sent;
+        if (sd->out_head == NULL)
+            sd->out_tail = NULL;
+
+        if (static_cast<std::size_t>(result) < total) {
+            sys::log::NetworkEngine::verbose("<%s> socket (%i): partial write (%li of %lu bytes)", name, sd->s, result, total);
+            break;
+        }
+    }
+
+    if (corked)
+        NetworkEngine::socket_mode_cork(sd->s, false);
+    if (sd->out_head != NULL)
+        wait_writable(sd);
+    else if (sd->out_close)
+        NetworkEngine::socket_shutdown(sd->s);
+}
+
+
+void NetworkEngineSend::wait_writable(SocketData* sd) {
+    sd->out_blocked = true;
+
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        blocked.push_back(sd);
+    #else
+        // NOTE: One-shot, so we are only told once and the socket doesn't keep waking us up while there
+        //       is nothing to write.
+        struct epoll_event event;
+        event.data.ptr = sd;
+        event.events = EPOLLOUT | EPOLLONESHOT;
+        if (epoll_ctl(epoll_fd, sd->out_watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, sd->s, &event) == -1) {
+            sys::log::NetworkEngine::error("<%s> epoll_ctl(): watching socket (%i) - FAILED (%i:%s)", name, sd->s, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            sd->out_blocked = false;
+            drop_output(sd);
+            NetworkEngine::socket_shutdown(sd->s);
+            return;
+        }
+        sd->out_watched = true;
+        ++n_blocked;
+    #endif
+}
+
+
+bool NetworkEngineSend::all_written(void) {
+    if (NetworkEngine::instance().messagesToSend.size() > 0)
+        return false;
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        return blocked.empty();
+    #else
+        return (n_blocked == 0);
+    #endif
+}
+
+
+/***
+ * Releases all output queued for the connection. The connection is done for
+ * (broken, over its output limit or closed), so whatever the game queues for
+ * it after this is dropped as well, rather than written into a dead socket or
+ * a deflate stream that was cut off mid-block.
+ */
+void NetworkEngineSend::drop_output(SocketData* sd) {
+    sd->out_close = true;
+    while (sd->out_head != NULL) {
+        NetworkMessage* m = sd->out_head;
+        sd->out_head = m->next;
+        NetworkMessage::destruct(m);
+    }
+    sd->out_tail = NULL;
+    sd->out_offset = 0;
+    sd->out_queued = 0;
+    sd->out_zchunk = NULL;
+    sd->out_zroom = 0;
+    sd->out_zpending = false;
 }
 
 } // namespace net
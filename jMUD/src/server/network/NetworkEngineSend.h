@@ -4,6 +4,9 @@
 #include "NetworkEngineThread.h"   //
 #include "UnorderedArray.h" // UnorderedArray
 #include "NetworkCore.h"
+#include "NetworkCompress.h"
+
+#include <vector>           // std::vector
 
 
 namespace net {
@@ -21,6 +24,28 @@ private:
     NetworkEngineSend& operator=(const NetworkEngineSend&);
 
     void exec(void);
+    void remove_connections(void);
+    void close_connections(void);
+    void fetch_messages(void);
+    void flush(SocketData* sd);
+    void wait_writable(SocketData* sd);
+    void drop_output(SocketData* sd);
+    void close_output(SocketData* sd);
+    void queue_output(SocketData* sd, NetworkMessage* m);
+    bool all_written(void);
+    bool start_compression(SocketData* sd);
+    void compress_output(SocketData* sd, const char* data, std::size_t length, int mode);
+
+    std::vector<SocketData*> pending;   // Connections that got new output since the last flush.
+    DeflatePool zpool;
+
+    #if (NETWORK_POLLING == NETWORK_POLLING_USE_SELECT)
+        std::vector<SocketData*> blocked;
+    #else
+        int epoll_fd;
+        struct epoll_event *events;
+        std::size_t n_blocked;  // Connections waiting to become writable.
+    #endif
 };
 
 
@@ -6,12 +6,21 @@
 #include "NetworkCore.h"
 
 #include <thread>           // std::thread
+#include <atomic>           // std::atomic<T>
 #include <cstring>
 
+#if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+    #include <sys/eventfd.h>    // eventfd()
+    #include <poll.h>           // poll()
+#endif
+
 
 namespace net {
 
 
+// NOTE: Each thread owns an eventfd (control) that it keeps in its poll set, so other threads can wake it
+//       up with wakeup() when they've queued work for it, instead of it having to poll the queues. Where
+//       eventfd isn't available control stays INVALID_SOCKET and the threads fall back on their timeouts.
 class NetworkEngineThread {
 public:
     NetworkEngineThread():
@@ -19,12 +28,26 @@ public:
         control(INVALID_SOCKET),
         name(NULL),
         initialized(false),
-        running(false) {}
-    virtual ~NetworkEngineThread() {}
+        running(false),
+        waiting(false) {}
+    virtual ~NetworkEngineThread() {control_close();}
 
     virtual bool run(void) = 0;
 
+    void wakeup(void);  // Wakes the thread up if it's blocked waiting for events. Can be called from any thread.
+    void join(void) {if (t != NULL && t->joinable()) t->join();}    // Waits for the thread to exit.
+
 protected:
+    bool control_open(void);
+    void control_close(void);
+    void control_clear(void);           // Consumes pending wakeups, once control has been signalled.
+    void control_wait(int timeout);     // Blocks until woken up, or for timeout ms at the most.
+
+    // NOTE: A thread about to block calls wait_begin() *before* checking its queues for work one last time,
+    //       so a wakeup() for work queued after that check is never lost. wait_end() once done blocking.
+    void wait_begin(void);
+    void wait_end(void) {waiting.store(false, std::memory_order_relaxed);}
+
     std::thread* t;
     SOCKET control;
     char* name;
@@ -35,9 +58,76 @@ protected:
 private:
     NetworkEngineThread(const NetworkEngineThread&);
     NetworkEngineThread& operator=(const NetworkEngineThread&);
+
+    std::atomic<bool> waiting;  // Set while the thread is (about to be) blocked.
 };
 
 
+inline void NetworkEngineThread::wakeup(void) {
+    // NOTE: Pairs with the fence in wait_begin(), either we see the thread waiting or it sees our work.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiting.load(std::memory_order_relaxed) || !waiting.exchange(false))
+        return;
+
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (control != INVALID_SOCKET)
+            eventfd_write(control, 1);
+    #endif
+}
+
+
+inline void NetworkEngineThread::wait_begin(void) {
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+
+inline bool NetworkEngineThread::control_open(void) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        control = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (control == -1) {
+            control = INVALID_SOCKET;
+            return false;
+        }
+        return true;
+    #else
+        return false;
+    #endif
+}
+
+
+inline void NetworkEngineThread::control_close(void) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (control != INVALID_SOCKET)
+            ::close(control);
+    #endif
+    control = INVALID_SOCKET;
+}
+
+
+inline void NetworkEngineThread::control_clear(void) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        eventfd_t value;
+        if (control != INVALID_SOCKET)
+            eventfd_read(control, &value);
+    #endif
+}
+
+
+inline void NetworkEngineThread::control_wait(int timeout) {
+    #if (PLATFORM == PLATFORM_UNIX) && (SYSTEM == SYSTEM_LINUX)
+        if (control != INVALID_SOCKET) {
+            struct pollfd pfd = { control, POLLIN, 0 };
+            if (poll(&pfd, 1, timeout) > 0)
+                control_clear();
+            return;
+        }
+    #endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+}
+
+
 } // namespace net
 
 #endif // NETWORKENGINETHREAD_H
@@ -0,0 +1,190 @@
+/******************************************************************************
+ * file: NetworkMessagePool.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkMessagePool.h"
+#include "NetworkCore.h"
+
+#include <mutex>        // std::mutex
+#include <vector>       // std::vector
+
+
+namespace net {
+
+
+// Only the owning thread touches free/count and writes the hit/miss counters,
+// other threads only ever push onto returned.
+struct MessagePool::Cache {
+    Cache(void) : free(NULL), count(0), returned(NULL), hits(0), misses(0) {}
+
+    NetworkMessage* free;
+    std::size_t     count;
+    std::atomic<NetworkMessage*> returned;
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+};
+
+
+namespace {
+
+// NOTE: Caches are never deleted since messages from them can still be in flight when their thread exits.
+//       Instead they are retired and adopted by the next thread that needs a cache.
+std::mutex                      caches_mutex;
+std::vector<MessagePool::Cache*> caches_all;
+std::vector<MessagePool::Cache*> caches_retired;
+
+class CacheHandle {
+public:
+    CacheHandle(void) : cache(NULL) {}
+    ~CacheHandle(void) {
+        if (cache == NULL)
+            return;
+        std::lock_guard<std::mutex> lock(caches_mutex);
+        caches_retired.push_back(cache);
+    }
+    MessagePool::Cache* cache;
+};
+
+thread_local CacheHandle local;
+
+} // namespace
+
+
+std::atomic<uint64_t> MessagePool::size(0);
+std::atomic<uint64_t> MessagePool::peak(0);
+
+
+MessagePool::Cache* MessagePool::local_cache(void) {
+    if (local.cache != NULL)
+        return local.cache;
+
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    if (!caches_retired.empty()) {
+        local.cache = caches_retired.back();
+        caches_retired.pop_back();
+    } else {
+        local.cache = new Cache();
+        caches_all.push_back(local.cache);
+    }
+    return local.cache;
+}
+
+
+/***
+ * Returns an unused message, from the calling thread's cache if possible.
+ */
+NetworkMessage* MessagePool::allocate(void) {
+    Cache* c = local_cache();
+
+    if (c->free == NULL)
+        reclaim(c);
+
+    NetworkMessage* m = c->free;
+    if (m != NULL) {
+        c->free = m->pool_next;
+        --c->count;
+        c->hits.store(c->hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    } else {
+        m = new NetworkMessage();
+        m->pool_owner = c;
+        c->misses.store(c->misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        uint64_t n = size.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint64_t p = peak.load(std::memory_order_relaxed);
+        while (n > p && !peak.compare_exchange_weak(p, n, std::memory_order_relaxed)) {
+        }
+    }
+
+    m->pool_next = NULL;
+    return m;
+}
+
+
+/***
+ * Hands a message back to the cache it was allocated from. May be called from
+ * any thread.
+ */
+void MessagePool::release(NetworkMessage* m) {
+    assert(m != NULL);
+    Cache* c = m->pool_owner;
+
+    if (c == local.cache) {
+        if (c->count >= MaxCachedPerThread) {
+            discard(m);
+            return;
+        }
+        m->pool_next = c->free;
+        c->free = m;
+        ++c->count;
+        return;
+    }
+
+    NetworkMessage* head = c->returned.load(std::memory_order_relaxed);
+    do {
+        m->pool_next = head;
+    } while (!c->returned.compare_exchange_weak(head, m, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+/***
+ * Moves everything on the return stack onto the free list.
+ * NOTE: The whole stack is taken with a single exchange(), so nodes are never
+ *       popped individually and there is no ABA problem.
+ */
+void MessagePool::reclaim(Cache* c) {
+    NetworkMessage* m = c->returned.exchange(NULL, std::memory_order_acquire);
+    while (m != NULL) {
+        NetworkMessage* next = m->pool_next;
+        if (c->count >= MaxCachedPerThread) {
+            discard(m);
+        } else {
+            m->pool_next = c->free;
+            c->free = m;
+            ++c->count;
+        }
+        m = next;
+    }
+}
+
+
+void MessagePool::discard(NetworkMessage* m) {
+    delete m;
+    size.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+uint64_t MessagePool::GetHits(void) {
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    uint64_t n = 0;
+    for (Cache* c: caches_all)
+        n += c->hits.load(std::memory_order_relaxed);
+    return n;
+}
+
+
+uint64_t MessagePool::GetMisses(void) {
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    uint64_t n = 0;
+    for (Cache* c: caches_all)
+        n += c->misses.load(std::memory_order_relaxed);
+    return n;
+}
+
+
+void MessagePool::LogStatus(void) {
+    std::size_t nCaches;
+    {
+        std::lock_guard<std::mutex> lock(caches_mutex);
+        nCaches = caches_all.size();
+    }
+    sys::log::NetworkEngine::add(" messages: %lu allocated (peak %lu), %lu hits, %lu misses, %lu caches",
+            GetSize(), GetPeak(), GetHits(), GetMisses(), nCaches);
+}
+
+
+} // namespace net
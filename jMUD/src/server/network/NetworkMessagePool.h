@@ -0,0 +1,61 @@
+/******************************************************************************
+ * file: NetworkMessagePool.h
+ *
+ * description: Pool allocator for NetworkMessage objects. Every thread that
+ *              constructs messages gets its own cache, so allocation never
+ *              touches shared state. A message is always handed back to the
+ *              cache it came from: directly if destructed by the same thread,
+ *              else through the cache's lock-free return stack, which the
+ *              owner takes over in one go when its free list runs dry.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKMESSAGEPOOL_H
+#define NETWORKMESSAGEPOOL_H
+
+#include "config.h"
+
+#include <atomic>       // std::atomic<T>
+#include <cstddef>      // std::size_t
+
+
+namespace net {
+
+
+class NetworkMessage;
+
+
+class MessagePool {
+public:
+    // Free messages each thread may keep cached before deleting them.
+    static const std::size_t MaxCachedPerThread = 4096;
+
+    struct Cache;
+
+    static NetworkMessage* allocate(void);
+    static void            release(NetworkMessage* m);
+
+    // Statistics, summed over all caches.
+    static uint64_t GetHits(void);
+    static uint64_t GetMisses(void);
+    static uint64_t GetSize(void)  {return size.load(std::memory_order_relaxed);}    // Messages allocated.
+    static uint64_t GetPeak(void)  {return peak.load(std::memory_order_relaxed);}
+
+    static void LogStatus(void);
+
+private:
+    MessagePool(void);
+
+    static Cache* local_cache(void);
+    static void   reclaim(Cache* c);
+    static void   discard(NetworkMessage* m);
+
+    static std::atomic<uint64_t> size;
+    static std::atomic<uint64_t> peak;
+};
+
+
+} // namespace net
+
+#endif // NETWORKMESSAGEPOOL_H
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * file: NetworkRateLimit.h
+ *
+ * description: Token bucket used by the recv-threads to limit the input of
+ *              each connection. The bucket holds up to burst tokens and gains
+ *              rate tokens per second, anything using up tokens faster than
+ *              that is throttled once the bucket runs dry. Not thread-safe,
+ *              each bucket is only used by the thread owning the connection.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKRATELIMIT_H
+#define NETWORKRATELIMIT_H
+
+#include "config.h"
+
+#include <chrono>       // std::chrono::steady_clock
+
+
+namespace net {
+
+
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    TokenBucket(double r, double b) : rate(r), burst(b), tokens(b), last(Clock::now()) {}
+
+    // Adds the tokens gained since the last refill, up to burst.
+    void refill(Clock::time_point now) {
+        double gained = std::chrono::duration<double>(now - last).count() * rate;
+        last = now;
+        tokens = (tokens + gained < burst) ? tokens + gained : burst;
+    }
+
+    double available(void) const {return tokens;}
+
+    // Takes n tokens if there are that many.
+    bool take(double n) {
+        if (tokens < n)
+            return false;
+        tokens -= n;
+        return true;
+    }
+
+    // Takes n tokens even if there aren't that many, the bucket then has to refill past 0 first.
+    void charge(double n) {tokens -= n;}
+
+    // How long until there are n tokens again.
+    Clock::duration until(double n) const {
+        if (tokens >= n)
+            return Clock::duration::zero();
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((n - tokens) / rate));
+    }
+
+private:
+    double            rate;     // Tokens gained per second.
+    double            burst;    // Most tokens the bucket holds.
+    double            tokens;
+    Clock::time_point last;     // When the bucket was last refilled.
+};
+
+
+} // namespace net
+
+#endif // NETWORKRATELIMIT_H
@@ -0,0 +1,211 @@
+/******************************************************************************
+ * file: NetworkResolver.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkResolver.h"
+#include "NetworkEngine.h"
+#include "../GameEngine.h"
+
+#include <cstring>      // memcpy(), strcpy()
+
+
+namespace net {
+
+
+NetworkResolver::NetworkResolver(void) :
+    workers(),
+    requests(),
+    mutex_requests(),
+    requests_added(),
+    stopping(false),
+    entries(),
+    mutex_cache(),
+    n_lookups(0),
+    n_hits(0),
+    n_failed(0),
+    n_dropped(0)
+{
+}
+
+
+NetworkResolver::~NetworkResolver(void) {
+    stop();
+}
+
+
+bool NetworkResolver::start(unsigned int nThreads) {
+    stopping = false;
+    for (unsigned int i = 0; i < nThreads; i++) {
+        workers.push_back(new std::thread(&NetworkResolver::exec, this));
+    }
+    sys::log::NetworkEngine::debug("  %3lu resolver-threads spawned", workers.size());
+    return !workers.empty();
+}
+
+
+void NetworkResolver::stop(void) {
+    mutex_requests.lock();
+    stopping = true;
+    if (!requests.empty())
+        sys::log::NetworkEngine::debug("Resolver: dropping %lu queued lookup(s)", requests.size());
+    requests.clear();
+    mutex_requests.unlock();
+    requests_added.notify_all();
+
+    // NOTE: A worker stuck in getnameinfo() holds us up until the resolver gives up on it.
+    for (std::thread* t: workers) {
+        t->join();
+        delete t;
+    }
+    workers.clear();
+}
+
+
+/***
+ * Looks up the host name of the connection's peer. Called for every new
+ * connection, so all the work is left to the workers unless the address is
+ * in the cache already.
+ */
+void NetworkResolver::lookup(ConnectionID cid, const struct sockaddr_storage& addr, socklen_t size) {
+    Request r;
+    r.cid = cid;
+    memcpy(&r.addr, &addr, size);
+    r.size = size;
+    if (getnameinfo(reinterpret_cast<const struct sockaddr*>(&addr), size, r.ip, sizeof(r.ip), NULL, 0, NI_NUMERICHOST) != 0) {
+        sys::log::NetworkEngine::debug("Resolver: no numeric address for cid = %u, not looked up", cid);
+        return;
+    }
+
+    std::string name;
+    if (cached(r.ip, name)) {
+        ++n_hits;
+        post(cid, name);
+        return;
+    }
+
+    mutex_requests.lock();
+    if (stopping || requests.size() >= NetworkEngine::MaxQueuedLookups) {
+        mutex_requests.unlock();
+        ++n_dropped;
+        sys::log::NetworkEngine::verbose("Resolver: too many lookups queued, skipping %s (cid = %u)", r.ip, cid);
+        return;
+    }
+    requests.push_back(r);
+    mutex_requests.unlock();
+    requests_added.notify_one();
+}
+
+
+void NetworkResolver::LogStatus(void) {
+    mutex_cache.lock();
+    std::size_t nEntries = entries.size();
+    mutex_cache.unlock();
+    mutex_requests.lock();
+    std::size_t nQueued = requests.size();
+    mutex_requests.unlock();
+
+    sys::log::NetworkEngine::add(" resolver: %lu queued, %lu cached, lookups = %lu (%lu failed), hits = %lu, dropped = %lu",
+            nQueued, nEntries, n_lookups.load(), n_failed.load(), n_hits.load(), n_dropped.load());
+}
+
+
+/***
+ * Worker thread, takes one request at a time off the queue. Requests for the
+ * same address queued behind one already looked up are answered from the
+ * cache.
+ */
+void NetworkResolver::exec(void) {
+    std::unique_lock<std::mutex> lock(mutex_requests);
+
+    for (;;) {
+        requests_added.wait(lock, [this] {return stopping || !requests.empty();});
+        if (stopping)
+            break;
+
+        Request r = requests.front();
+        requests.pop_front();
+        lock.unlock();
+
+        std::string name;
+        if (cached(r.ip, name)) {
+            ++n_hits;
+        } else {
+            char host[NI_MAXHOST];
+            bool found = (getnameinfo(reinterpret_cast<const struct sockaddr*>(&r.addr), r.size, host, sizeof(host), NULL, 0, NI_NAMEREQD) == 0);
+            ++n_lookups;
+            if (!found) {
+                ++n_failed;
+                strcpy(host, r.ip);
+            }
+            name = host;
+            cache(r.ip, name, found);
+            sys::log::NetworkEngine::debug("Resolver: %s is %s (cid = %u)", r.ip, found ? host : "<unknown>", r.cid);
+        }
+        post(r.cid, name);
+
+        lock.lock();
+    }
+}
+
+
+bool NetworkResolver::cached(const char* ip, std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_cache);
+
+    auto it = entries.find(ip);
+    if (it == entries.end())
+        return false;
+    if (it->second.expires <= std::chrono::steady_clock::now()) {
+        entries.erase(it);
+        return false;
+    }
+    name = it->second.name;
+    return true;
+}
+
+
+/***
+ * Remembers the result of a lookup, for DNSCacheTTL seconds or the shorter
+ * DNSNegativeCacheTTL if no name was found. A full cache is first cleared of
+ * expired entries, and if that doesn't help emptied.
+ */
+void NetworkResolver::cache(const char* ip, const std::string& name, bool found) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_cache);
+
+    if (entries.size() >= NetworkEngine::MaxCachedLookups) {
+        for (auto it = entries.begin(); it != entries.end(); ) {
+            if (it->second.expires <= now)
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+        if (entries.size() >= NetworkEngine::MaxCachedLookups)
+            entries.clear();
+    }
+
+    int ttl = NetworkEngine::DNSNegativeCacheTTL;
+    if (found)
+        ttl = NetworkEngine::DNSCacheTTL;
+
+    Entry& e = entries[ip];
+    e.name = name;
+    e.expires = now + std::chrono::seconds(ttl);
+}
+
+
+/***
+ * Hands the name to the game. The data is '\0' terminated, which size doesn't
+ * include.
+ */
+void NetworkResolver::post(ConnectionID cid, const std::string& name) {
+    char* buffer = BufferPool::allocate_unpooled(name.size() + 1);
+    memcpy(buffer, name.c_str(), name.size() + 1);
+    GameEngine::instance().AddMessageRecv(NetworkMessage::construct(cid, net::MessageTypes::DNSLookup, name.size(), buffer));
+}
+
+
+} // namespace net
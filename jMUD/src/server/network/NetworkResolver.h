@@ -0,0 +1,93 @@
+/******************************************************************************
+ * file: NetworkResolver.h
+ *
+ * description: Reverse DNS lookups of the peers of new connections, done by a
+ *              small pool of worker threads so neither the accept-threads nor
+ *              anything else ever waits on a slow resolver. Each completed
+ *              lookup is posted to the game as a DNSLookup message carrying
+ *              the host name (the numeric address if it has none). Results,
+ *              failures included, are cached per address for a while, so a
+ *              burst of connections from the same host costs one lookup.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKRESOLVER_H
+#define NETWORKRESOLVER_H
+
+#include "config.h"
+#include "NetworkCore.h"
+
+#if (PLATFORM == PLATFORM_UNIX)
+    #include <sys/socket.h>     // struct sockaddr_storage
+    #include <netdb.h>          // NI_MAXHOST
+#endif
+
+#include <atomic>               // std::atomic<T>
+#include <chrono>               // std::chrono::steady_clock
+#include <condition_variable>   // std::condition_variable
+#include <deque>                // std::deque<T>
+#include <mutex>                // std::mutex
+#include <string>               // std::string
+#include <thread>               // std::thread
+#include <unordered_map>        // std::unordered_map<K, T>
+#include <vector>               // std::vector<T>
+
+
+namespace net {
+
+
+class NetworkResolver {
+public:
+    NetworkResolver(void);
+    ~NetworkResolver(void);
+
+    bool start(unsigned int nThreads);
+    void stop(void);        // Lookups still queued are dropped.
+
+    // Never blocks on the resolver: a cached name is posted at once, anything else is queued for the
+    // workers, or skipped if too many lookups are queued already.
+    void lookup(ConnectionID cid, const struct sockaddr_storage& addr, socklen_t size);
+
+    void LogStatus(void);
+
+private:
+    NetworkResolver(const NetworkResolver&);
+    NetworkResolver& operator=(const NetworkResolver&);
+
+    struct Request {
+        ConnectionID            cid;
+        struct sockaddr_storage addr;
+        socklen_t               size;
+        char                    ip[NI_MAXHOST];     // Numeric address, the cache key.
+    };
+
+    struct Entry {
+        std::string                           name;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    void exec(void);
+    bool cached(const char* ip, std::string& name);
+    void cache(const char* ip, const std::string& name, bool found);
+    static void post(ConnectionID cid, const std::string& name);
+
+    std::vector<std::thread*> workers;
+    std::deque<Request>       requests;
+    std::mutex                mutex_requests;
+    std::condition_variable   requests_added;
+    bool                      stopping;     // NOTE: Protected by mutex_requests.
+
+    std::unordered_map<std::string, Entry> entries;
+    std::mutex                             mutex_cache;
+
+    std::atomic<uint64_t> n_lookups;    // Done by the workers.
+    std::atomic<uint64_t> n_hits;       // Answered from the cache.
+    std::atomic<uint64_t> n_failed;     // Lookups that found no name.
+    std::atomic<uint64_t> n_dropped;    // Skipped, the queue was full.
+};
+
+
+} // namespace net
+
+#endif // NETWORKRESOLVER_H
@@ -0,0 +1,120 @@
+/******************************************************************************
+ * file: NetworkSocketTable.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkSocketTable.h"
+
+#include <new>          // placement new
+
+
+namespace net {
+
+
+SocketData* SocketData::construct(SOCKET sock) {
+    assert(sock != INVALID_SOCKET);
+    return SocketTable::instance().allocate(sock);
+}
+
+
+void SocketData::destruct(SocketData* sd) {
+    SocketTable::instance().release(sd);
+}
+
+
+SocketTable::SocketTable(void) :
+    chunks(),
+    mutex(),
+    free_slots(),
+    next_index(0),
+    used(0)
+{
+    for (std::size_t i = 0; i < NumChunks; i++)
+        chunks[i].store(NULL, std::memory_order_relaxed);
+}
+
+
+SocketTable::~SocketTable(void) {
+    for (std::size_t i = 0; i < NumChunks; i++)
+        delete[] chunks[i].load(std::memory_order_relaxed);
+}
+
+
+/***
+ * Constructs the SocketData for a new connection in a free slot and assigns
+ * it a ConnectionID.
+ */
+SocketData* SocketTable::allocate(SOCKET s) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t index;
+    if (!free_slots.empty()) {
+        index = free_slots.back();
+        free_slots.pop_back();
+    } else if (next_index < MaxSlots) {
+        index = static_cast<uint32_t>(next_index++);
+        if ((index & (ChunkSize - 1)) == 0) {
+            chunks[index >> ChunkBits].store(new Slot[ChunkSize], std::memory_order_release);
+        }
+    } else {
+        sys::log::NetworkEngine::error("SocketTable: all %lu slots are in use.", MaxSlots);
+        return NULL;
+    }
+
+    Slot* sl = slot(index);
+    ConnectionID cid = (sl->generation << IndexBits) | index;
+    SocketData* sd = new (sl->storage) SocketData(cid, s);
+    sl->cid.store(cid, std::memory_order_release);
+    ++used;
+
+    return sd;
+}
+
+
+/***
+ * Destructs the SocketData and frees its slot. Any lookup() of the cid made
+ * after this returns NULL.
+ */
+void SocketTable::release(SocketData* sd) {
+    assert(sd != NULL);
+    assert(lookup(sd->cid) == sd);
+
+    uint32_t index = sd->cid & IndexMask;
+    Slot* sl = slot(index);
+    sl->cid.store(InvalidConnectionID, std::memory_order_release);
+    BufferPool::release(sd->rx_line);
+    sd->~SocketData();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    sl->generation = (sl->generation == MaxGeneration) ? 1 : sl->generation + 1;
+    free_slots.push_back(index);
+    --used;
+}
+
+
+/***
+ * The connections can come and go meanwhile, so some of the cids may be gone
+ * already when they're used. Look them up again.
+ */
+void SocketTable::connections(std::vector<ConnectionID>& cids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cids.reserve(cids.size() + used);
+    for (std::size_t i = 0; i < next_index; i++) {
+        ConnectionID cid = slot(static_cast<uint32_t>(i))->cid.load(std::memory_order_acquire);
+        if (cid != InvalidConnectionID)
+            cids.push_back(cid);
+    }
+}
+
+
+void SocketTable::LogStatus(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sys::log::NetworkEngine::add(" sockets: %lu slots in use, %lu allocated (%lu KiB)",
+            used, next_index, ((next_index + ChunkSize - 1) / ChunkSize) * ChunkSize * sizeof(Slot) / 1024);
+}
+
+
+} // namespace net
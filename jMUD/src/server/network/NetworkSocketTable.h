@@ -0,0 +1,105 @@
+/******************************************************************************
+ * file: NetworkSocketTable.h
+ *
+ * description: Slot table holding the SocketData of all connections. The
+ *              ConnectionID of a connection encodes its slot index together
+ *              with the slot's generation, so a cid resolves to its SocketData
+ *              in O(1) from any thread, and a stale cid (for a connection
+ *              that has since been closed) never resolves to the connection
+ *              that reused the slot.
+ *
+ *              Slots are allocated in chunks that are never released, so a
+ *              lookup never needs a lock and never touches freed memory.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKSOCKETTABLE_H
+#define NETWORKSOCKETTABLE_H
+
+#include "config.h"
+#include "NetworkCore.h"
+
+#include <atomic>       // std::atomic<T>
+#include <mutex>        // std::mutex
+#include <vector>       // std::vector
+
+
+namespace net {
+
+
+class SocketTable {
+public:
+    // ConnectionID layout: [generation:12][index:20]. The generation is never 0, so neither is a valid cid.
+    static const unsigned int IndexBits = 20;
+    static const unsigned int GenerationBits = 32 - IndexBits;
+    static const uint32_t     IndexMask = (1u << IndexBits) - 1;
+    static const uint32_t     MaxGeneration = (1u << GenerationBits) - 1;
+    static const std::size_t  MaxSlots = std::size_t(1) << IndexBits;
+
+    // Slots are allocated ChunkSize at a time, keeping neighbouring connections in contiguous memory.
+    static const unsigned int ChunkBits = 8;
+    static const std::size_t  ChunkSize = std::size_t(1) << ChunkBits;
+    static const std::size_t  NumChunks = MaxSlots / ChunkSize;
+
+    static SocketTable& instance(void);
+
+    SocketData* allocate(SOCKET s);         // NULL if the table is full.
+    void        release(SocketData* sd);
+    SocketData* lookup(ConnectionID cid);   // NULL if cid isn't (or no longer) a connection.
+    void        connections(std::vector<ConnectionID>& cids);   // Appends the cids of all connections.
+
+    void LogStatus(void);
+
+private:
+    SocketTable(void);
+    ~SocketTable(void);
+
+    SocketTable(const SocketTable&);
+    SocketTable& operator=(const SocketTable&);
+
+    struct Slot {
+        Slot(void) : cid(InvalidConnectionID), generation(1), storage() {}
+        SocketData* data(void) {return reinterpret_cast<SocketData*>(storage);}
+
+        std::atomic<ConnectionID> cid;  // InvalidConnectionID while the slot is free.
+        uint32_t generation;
+        alignas(SocketData) unsigned char storage[sizeof(SocketData)];
+    };
+
+    Slot* slot(uint32_t index) {return &chunks[index >> ChunkBits].load(std::memory_order_acquire)[index & (ChunkSize - 1)];}
+
+    std::atomic<Slot*> chunks[NumChunks];
+
+    std::mutex            mutex;        // Protects everything below.
+    std::vector<uint32_t> free_slots;   // NOTE: Reused LIFO, the most recently freed slot is the most likely to be cached.
+    std::size_t           next_index;   // First slot index never handed out.
+    std::size_t           used;
+};
+
+
+inline SocketTable& SocketTable::instance(void) {
+    static SocketTable instanceOfSocketTable;
+    return instanceOfSocketTable;
+}
+
+
+inline SocketData* SocketTable::lookup(ConnectionID cid) {
+    if (cid == InvalidConnectionID)
+        return NULL;
+
+    uint32_t index = cid & IndexMask;
+    Slot* chunk = chunks[index >> ChunkBits].load(std::memory_order_acquire);
+    if (chunk == NULL)
+        return NULL;
+
+    Slot* s = &chunk[index & (ChunkSize - 1)];
+    if (s->cid.load(std::memory_order_acquire) != cid)
+        return NULL;
+    return s->data();
+}
+
+
+} // namespace net
+
+#endif // NETWORKSOCKETTABLE_H
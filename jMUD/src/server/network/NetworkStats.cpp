@@ -0,0 +1,159 @@
+/******************************************************************************
+ * file: NetworkStats.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkStats.h"
+
+#include <cstdio>       // snprintf()
+#include <mutex>        // std::mutex
+#include <vector>       // std::vector
+
+
+namespace net {
+
+
+namespace {
+
+// NOTE: Blocks are never deleted, what a thread counted still belongs in the totals after it exits. Instead
+//       they are retired and adopted by the next thread that needs one.
+std::mutex                          counters_mutex;
+std::vector<NetworkStats::Counters*> counters_all;
+std::vector<NetworkStats::Counters*> counters_retired;
+
+class CountersHandle {
+public:
+    CountersHandle(void) : counters(NULL) {}
+    ~CountersHandle(void) {
+        if (counters == NULL)
+            return;
+        std::lock_guard<std::mutex> lock(counters_mutex);
+        counters_retired.push_back(counters);
+    }
+    NetworkStats::Counters* counters;
+};
+
+thread_local CountersHandle local_counters;
+
+} // namespace
+
+
+NetworkStats::Counters::Counters(void) :
+    rx_bytes(0), rx_reads(0), tx_bytes(0), tx_writes(0), tx_deflate_in(0), tx_deflate_out(0), accepts(0),
+    wakeups(0), wakeup_events(0), read_sizes(), wakeup_batches()
+{
+    for (std::size_t i = 0; i < HistogramBuckets; i++) {
+        read_sizes[i].store(0, std::memory_order_relaxed);
+        wakeup_batches[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+NetworkStats::NetworkStats(void) :
+    rx_bytes(0), rx_reads(0), tx_bytes(0), tx_writes(0), tx_deflate_in(0), tx_deflate_out(0), accepts(0),
+    wakeups(0), wakeup_events(0), read_sizes(), wakeup_batches(), threads(0)
+{
+}
+
+
+NetworkStats::Counters& NetworkStats::local(void) {
+    if (local_counters.counters != NULL)
+        return *local_counters.counters;
+
+    std::lock_guard<std::mutex> lock(counters_mutex);
+    if (!counters_retired.empty()) {
+        local_counters.counters = counters_retired.back();
+        counters_retired.pop_back();
+    } else {
+        local_counters.counters = new Counters();
+        counters_all.push_back(local_counters.counters);
+    }
+    return *local_counters.counters;
+}
+
+
+/***
+ * Sums the counters of all threads. The threads keep counting meanwhile, so
+ * the totals aren't from one single instant, but every value is at most as
+ * old as the call.
+ */
+NetworkStats NetworkStats::snapshot(void) {
+    NetworkStats s;
+    std::lock_guard<std::mutex> lock(counters_mutex);
+
+    for (const Counters* c: counters_all) {
+        s.rx_bytes += c->rx_bytes.load(std::memory_order_relaxed);
+        s.rx_reads += c->rx_reads.load(std::memory_order_relaxed);
+        s.tx_bytes += c->tx_bytes.load(std::memory_order_relaxed);
+        s.tx_writes += c->tx_writes.load(std::memory_order_relaxed);
+        s.tx_deflate_in += c->tx_deflate_in.load(std::memory_order_relaxed);
+        s.tx_deflate_out += c->tx_deflate_out.load(std::memory_order_relaxed);
+        s.accepts += c->accepts.load(std::memory_order_relaxed);
+        s.wakeups += c->wakeups.load(std::memory_order_relaxed);
+        s.wakeup_events += c->wakeup_events.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < HistogramBuckets; i++) {
+            s.read_sizes[i] += c->read_sizes[i].load(std::memory_order_relaxed);
+            s.wakeup_batches[i] += c->wakeup_batches[i].load(std::memory_order_relaxed);
+        }
+    }
+    s.threads = counters_all.size();
+    return s;
+}
+
+
+uint64_t NetworkStats::percentile(const uint64_t* histogram, uint64_t total, double p) {
+    if (total == 0)
+        return 0;
+
+    // NOTE: The counts can be summed a little after total was, so don't trust them to add up to it.
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < HistogramBuckets - 1; i++) {
+        seen += histogram[i];
+        if (seen > rank)
+            return bucket_high(i);
+    }
+    return bucket_low(HistogramBuckets - 1);
+}
+
+
+void NetworkStats::LogStatus(void) const {
+    sys::log::NetworkEngine::add(" RX = %lu KiB (%lu reads), TX = %lu KiB (%lu writes), %lu accepted",
+            rx_bytes/1024, rx_reads, tx_bytes/1024, tx_writes, accepts);
+    if (tx_deflate_out > 0) {
+        sys::log::NetworkEngine::add(" MCCP2 = %lu KiB -> %lu KiB (ratio %.2f)",
+                tx_deflate_in/1024, tx_deflate_out/1024, static_cast<double>(tx_deflate_in) / static_cast<double>(tx_deflate_out));
+    }
+    if (rx_reads > 0) {
+        sys::log::NetworkEngine::add(" read size: avg %lu, p50 <= %lu, p99 <= %lu bytes",
+                rx_bytes / rx_reads, ReadSizePercentile(50), ReadSizePercentile(99));
+        log_histogram("read size", read_sizes);
+    }
+    if (wakeups > 0) {
+        sys::log::NetworkEngine::add(" recv wakeups: %lu, avg %.1f, p50 <= %lu, p99 <= %lu events/wakeup",
+                wakeups, static_cast<double>(wakeup_events) / wakeups, WakeupBatchPercentile(50), WakeupBatchPercentile(99));
+        log_histogram("events/wakeup", wakeup_batches);
+    }
+}
+
+
+void NetworkStats::log_histogram(const char* what, const uint64_t* histogram) {
+    char line[1024];
+    std::size_t length = 0;
+    for (std::size_t i = 0; i < HistogramBuckets && length < sizeof(line); i++) {
+        if (histogram[i] == 0)
+            continue;
+        if (i == HistogramBuckets - 1)
+            length += snprintf(line + length, sizeof(line) - length, " [%lu-]:%lu", bucket_low(i), histogram[i]);
+        else
+            length += snprintf(line + length, sizeof(line) - length, " [%lu-%lu]:%lu", bucket_low(i), bucket_high(i), histogram[i]);
+    }
+    if (length > 0)
+        sys::log::NetworkEngine::add("  %s:%s", what, line);
+}
+
+
+} // namespace net
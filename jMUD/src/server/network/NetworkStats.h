@@ -0,0 +1,117 @@
+/******************************************************************************
+ * file: NetworkStats.h
+ *
+ * description: Statistics of the network threads. Every thread counts into a
+ *              block of its own, padded to a cache line so no two threads ever
+ *              write the same line, and being the only writer it updates its
+ *              counters with plain relaxed loads and stores, no locked
+ *              instructions. snapshot() sums all blocks into a NetworkStats
+ *              object, which never changes after that. Besides the totals it
+ *              holds histograms of the read sizes and of the events handled
+ *              per recv-thread wakeup.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKSTATS_H
+#define NETWORKSTATS_H
+
+#include "config.h"
+
+#include <atomic>       // std::atomic<T>
+#include <bit>          // std::bit_width()
+#include <cstddef>      // std::size_t
+#include <cstdint>      // uint64_t
+
+
+namespace net {
+
+
+class NetworkStats {
+public:
+    // Histogram bucket 0 counts 0, bucket i (i > 0) counts 2^(i-1) to 2^i - 1 and the last bucket everything
+    // from there on up.
+    static const std::size_t HistogramBuckets = 20;
+
+    // The counters of one thread. Only that thread may call the update methods.
+    struct alignas(64) Counters {
+        Counters(void);
+
+        void read(std::size_t bytes)  {add(rx_bytes, bytes); add(rx_reads, 1); add(read_sizes[bucket(bytes)], 1);}
+        void wrote(std::size_t bytes) {add(tx_bytes, bytes); add(tx_writes, 1);}
+        void deflated(std::size_t in, std::size_t out) {add(tx_deflate_in, in); add(tx_deflate_out, out);}
+        void accepted(void)           {add(accepts, 1);}
+        void woke(std::size_t events) {add(wakeups, 1); add(wakeup_events, events); add(wakeup_batches[bucket(events)], 1);}
+
+        std::atomic<uint64_t> rx_bytes;
+        std::atomic<uint64_t> rx_reads;
+        std::atomic<uint64_t> tx_bytes;
+        std::atomic<uint64_t> tx_writes;
+        std::atomic<uint64_t> tx_deflate_in;    // MCCP2: output before and after compression.
+        std::atomic<uint64_t> tx_deflate_out;
+        std::atomic<uint64_t> accepts;
+        std::atomic<uint64_t> wakeups;          // Recv-thread wakeups, and the events they handled.
+        std::atomic<uint64_t> wakeup_events;
+        std::atomic<uint64_t> read_sizes[HistogramBuckets];
+        std::atomic<uint64_t> wakeup_batches[HistogramBuckets];
+
+      private:
+        // NOTE: A single writer, so no read-modify-write needed. Readers may see a slightly old value.
+        static void add(std::atomic<uint64_t>& c, uint64_t n) {c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);}
+    };
+
+    static Counters&    local(void);        // The calling thread's counters.
+    static NetworkStats snapshot(void);     // Sums the counters of all threads.
+
+    static std::size_t bucket(uint64_t value);
+    static uint64_t    bucket_low(std::size_t i)  {return (i == 0) ? 0 : uint64_t(1) << (i - 1);}
+    static uint64_t    bucket_high(std::size_t i) {return (i == 0) ? 0 : (uint64_t(1) << i) - 1;}
+
+    uint64_t BytesRecv(void) const      {return rx_bytes;}
+    uint64_t Reads(void) const          {return rx_reads;}
+    uint64_t BytesSend(void) const      {return tx_bytes;}
+    uint64_t Writes(void) const         {return tx_writes;}
+    uint64_t DeflateIn(void) const      {return tx_deflate_in;}
+    uint64_t DeflateOut(void) const     {return tx_deflate_out;}
+    uint64_t Accepts(void) const        {return accepts;}
+    uint64_t Wakeups(void) const        {return wakeups;}
+    uint64_t WakeupEvents(void) const   {return wakeup_events;}
+    std::size_t Threads(void) const     {return threads;}
+
+    uint64_t ReadSizes(std::size_t i) const     {return read_sizes[i];}
+    uint64_t WakeupBatches(std::size_t i) const {return wakeup_batches[i];}
+    uint64_t ReadSizePercentile(double p) const     {return percentile(read_sizes, rx_reads, p);}
+    uint64_t WakeupBatchPercentile(double p) const  {return percentile(wakeup_batches, wakeups, p);}
+
+    void LogStatus(void) const;
+
+private:
+    NetworkStats(void);
+
+    static uint64_t percentile(const uint64_t* histogram, uint64_t total, double p);   // Upper bound of its bucket.
+    static void     log_histogram(const char* what, const uint64_t* histogram);
+
+    uint64_t    rx_bytes;
+    uint64_t    rx_reads;
+    uint64_t    tx_bytes;
+    uint64_t    tx_writes;
+    uint64_t    tx_deflate_in;
+    uint64_t    tx_deflate_out;
+    uint64_t    accepts;
+    uint64_t    wakeups;
+    uint64_t    wakeup_events;
+    uint64_t    read_sizes[HistogramBuckets];
+    uint64_t    wakeup_batches[HistogramBuckets];
+    std::size_t threads;    // Counter blocks summed.
+};
+
+
+inline std::size_t NetworkStats::bucket(uint64_t value) {
+    std::size_t i = std::bit_width(value);
+    return (i < HistogramBuckets) ? i : HistogramBuckets - 1;
+}
+
+
+} // namespace net
+
+#endif // NETWORKSTATS_H
@@ -0,0 +1,163 @@
+/******************************************************************************
+ * file: NetworkTelnet.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "NetworkTelnet.h"
+
+#include <cstring>      // memmove()
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>  // _mm_cmpeq_epi8(), _mm_movemask_epi8()
+#endif
+
+
+namespace net {
+
+
+/***
+ * Returns the first IAC, CR or LF in [p, end), or end if there is none.
+ */
+inline const char* TelnetDecoder::scan(const char* p, const char* end) {
+    #if defined(__SSE2__)
+        const __m128i iac = _mm_set1_epi8(static_cast<char>(telnet::IAC));
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, iac), _mm_cmpeq_epi8(v, cr)), _mm_cmpeq_epi8(v, lf));
+            int mask = _mm_movemask_epi8(hit);
+            if (mask != 0)
+                return p + __builtin_ctz(static_cast<unsigned int>(mask));
+            p += 16;
+        }
+    #endif
+
+    while (p < end && *p != static_cast<char>(telnet::IAC) && *p != '\r' && *p != '\n')
+        ++p;
+    return p;
+}
+
+
+/***
+ * Decodes the data in place. Plain text is only moved if a command sequence
+ * before it (in this buffer) has been removed, so lines are usually left
+ * where they were read. A line still going on at the end of the data is
+ * added as a partial line (not ending with '\n').
+ */
+void TelnetDecoder::decode(char* data, std::size_t length, std::vector<TelnetLine>& lines, std::vector<TelnetEvent>& events) {
+    const char* in = data;
+    const char* end = data + length;
+    char* out = data;       // Where the next decoded byte goes, never past in.
+    char* line = data;      // Start of the current line.
+
+    while (in < end) {
+        uint8_t c = static_cast<uint8_t>(*in);
+
+        switch (state) {
+        case Data: {
+            if (cr) {
+                cr = false;
+                if (c == '\n' || c == '\0') {
+                    ++in;
+                    continue;
+                }
+            }
+
+            const char* hit = scan(in, end);
+            if (hit != in) {
+                std::size_t n = static_cast<std::size_t>(hit - in);
+                if (out != in)
+                    memmove(out, in, n);
+                out += n;
+                in = hit;
+                continue;
+            }
+
+            ++in;
+            if (c == telnet::IAC) {
+                state = Iac;
+            } else {
+                // CR or LF, either way the line ends here.
+                cr = (c == '\r');
+                *out++ = '\n';
+                lines.push_back({line, static_cast<std::size_t>(out - line)});
+                line = out;
+            }
+            break;
+        }
+
+        case Iac:
+            ++in;
+            switch (c) {
+            case telnet::IAC:
+                // Escaped 0xFF data byte.
+                *out++ = static_cast<char>(telnet::IAC);
+                state = Data;
+                break;
+            case telnet::WILL:
+            case telnet::WONT:
+            case telnet::DO:
+            case telnet::DONT:
+                command = c;
+                state = Option;
+                break;
+            case telnet::SB:
+                state = SbOption;
+                break;
+            case telnet::NOP:
+                state = Data;
+                break;
+            default:
+                events.push_back({c, 0});
+                state = Data;
+                break;
+            }
+            break;
+
+        case Option:
+            ++in;
+            events.push_back({command, c});
+            state = Data;
+            break;
+
+        case SbOption:
+            ++in;
+            option = c;
+            state = Sb;
+            break;
+
+        case Sb: {
+            // NOTE: The subnegotiation data is dropped, so skip ahead to the next IAC.
+            const void* iac = memchr(in, telnet::IAC, static_cast<std::size_t>(end - in));
+            if (iac == NULL) {
+                in = end;
+            } else {
+                in = static_cast<const char*>(iac) + 1;
+                state = SbIac;
+            }
+            break;
+        }
+
+        case SbIac:
+            ++in;
+            if (c == telnet::SE) {
+                events.push_back({telnet::SB, option});
+                state = Data;
+            } else {
+                // IAC IAC is an escaped 0xFF in the data, anything else is a protocol error we let pass.
+                state = Sb;
+            }
+            break;
+        }
+    }
+
+    if (out != line)
+        lines.push_back({line, static_cast<std::size_t>(out - line)});
+}
+
+
+} // namespace net
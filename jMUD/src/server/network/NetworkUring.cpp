@@ -0,0 +1,303 @@
+/******************************************************************************
+ * file: NetworkUring.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "log.h"
+#include "NetworkUring.h"
+#include "NetworkEngine.h"
+
+#if (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+
+#include <sys/mman.h>           // mmap()
+#include <sys/syscall.h>        // __NR_io_uring_*
+#include <unistd.h>             // syscall()
+#include <cstring>              // memset()
+#include <cerrno>
+
+
+namespace net {
+
+
+static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags, void* arg, std::size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz));
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr));
+}
+
+
+NetworkUring::NetworkUring(void) :
+    ring_fd(-1),
+    sq_ptr(MAP_FAILED), sq_size(0), sq_head(NULL), sq_tail(NULL), sq_mask(NULL), sq_array(NULL), sq_pending(0),
+    sqes(NULL), sqes_size(0),
+    cq_ptr(MAP_FAILED), cq_size(0), cq_head(NULL), cq_tail(NULL), cq_mask(NULL), cqes(NULL),
+    buf_ring(NULL), buf_ring_size(0), buf_ring_mask(0), buf_ring_pending(0), buf_group(0),
+    buffers(NULL), buffer_size(0), buffer_count(0)
+{
+}
+
+
+NetworkUring::~NetworkUring(void) {
+    if (buffers != NULL)
+        munmap(buffers, buffer_size * buffer_count);
+    if (buf_ring != NULL)
+        munmap(buf_ring, buf_ring_size);
+    if (sqes != NULL)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+        munmap(sq_ptr, sq_size);
+    if (ring_fd != -1)
+        ::close(ring_fd);
+}
+
+
+/***
+ * Checks if the running kernel has everything we need, which is multishot
+ * recv (5.19+/6.0+) and provided buffer rings (5.19+).
+ */
+bool NetworkUring::is_supported(void) {
+    NetworkUring ring;
+    if (ring.setup(4) == false)
+        return false;
+    return ring.setup_buffer_ring(0, 1, 64);
+}
+
+
+/***
+ * Creates the ring and maps the submission and completion queues.
+ */
+bool NetworkUring::setup(unsigned int entries) {
+    assert(ring_fd == -1);
+
+    // NOTE: The ring is created by the thread spawning the recv-thread, so IORING_SETUP_SINGLE_ISSUER
+    //       can't be used.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    ring_fd = sys_io_uring_setup(entries, &p);
+    if (ring_fd < 0) {
+        sys::log::NetworkEngine::error("io_uring_setup(%u) - FAILED (%i:%s)", entries, NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        ring_fd = -1;
+        return false;
+    }
+    if ((p.features & IORING_FEAT_EXT_ARG) == 0) {
+        sys::log::NetworkEngine::error("io_uring: kernel lacks IORING_FEAT_EXT_ARG (needs 5.11+).");
+        return false;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+        sys::log::NetworkEngine::error("io_uring: mmap() of SQ ring - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr = sq_ptr;
+    } else {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            sys::log::NetworkEngine::error("io_uring: mmap() of CQ ring - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+            return false;
+        }
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* s = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (s == MAP_FAILED) {
+        sys::log::NetworkEngine::error("io_uring: mmap() of SQEs - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(s);
+
+    char* sq = static_cast<char*>(sq_ptr);
+    sq_head  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask  = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ptr);
+    cq_head  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask  = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes     = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    sys::log::NetworkEngine::debug("io_uring (%i): created (sq = %u, cq = %u entries)", ring_fd, p.sq_entries, p.cq_entries);
+    return true;
+}
+
+
+/***
+ * Allocates count buffers of size bytes each and registers them with the
+ * kernel as buffer group 'group'. The count has to be a power of two.
+ */
+bool NetworkUring::setup_buffer_ring(uint16_t group, unsigned int count, unsigned int size) {
+    assert(ring_fd != -1);
+    assert(buf_ring == NULL);
+    assert(count > 0 && (count & (count - 1)) == 0 && count <= 32768);
+
+    buf_ring_size = count * sizeof(struct io_uring_buf);
+    void* r = mmap(NULL, buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (r == MAP_FAILED) {
+        sys::log::NetworkEngine::error("io_uring: mmap() of buffer ring - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        return false;
+    }
+    buf_ring = static_cast<struct io_uring_buf_ring*>(r);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        sys::log::NetworkEngine::error("io_uring: register buffer ring - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        munmap(buf_ring, buf_ring_size);
+        buf_ring = NULL;
+        return false;
+    }
+
+    buffer_size = size;
+    buffer_count = count;
+    void* b = mmap(NULL, buffer_size * buffer_count, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (b == MAP_FAILED) {
+        sys::log::NetworkEngine::error("io_uring: mmap() of buffers - FAILED (%i:%s)", NetworkEngine::get_error_code(), NetworkEngine::get_error_msg());
+        buffers = NULL;
+        return false;
+    }
+    buffers = static_cast<char*>(b);
+
+    buf_group = group;
+    buf_ring_mask = count - 1;
+    buf_ring->tail = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        buffer_recycle(static_cast<uint16_t>(i));
+    }
+    buffer_commit();
+
+    sys::log::NetworkEngine::debug("io_uring (%i): buffer group %hu (%u x %u bytes)", ring_fd, group, count, size);
+    return true;
+}
+
+
+struct io_uring_sqe* NetworkUring::get_sqe(void) {
+    unsigned head = std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+    unsigned tail = *sq_tail + sq_pending;
+    if (tail - head > *sq_mask)
+        return NULL;
+
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sq_pending;
+    return sqe;
+}
+
+
+bool NetworkUring::prepare_recv_multishot(SOCKET s, uint64_t user_data) {
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == NULL) {
+        submit();
+        if ((sqe = get_sqe()) == NULL)
+            return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buf_group;
+    sqe->user_data = user_data;
+    return true;
+}
+
+
+bool NetworkUring::prepare_poll_multishot(int fd, uint64_t user_data) {
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == NULL) {
+        submit();
+        if ((sqe = get_sqe()) == NULL)
+            return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+    return true;
+}
+
+
+bool NetworkUring::prepare_cancel(uint64_t user_data) {
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == NULL) {
+        submit();
+        if ((sqe = get_sqe()) == NULL)
+            return false;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = 0;     // NOTE: Completions with user_data 0 are ignored.
+    return true;
+}
+
+
+int NetworkUring::submit(void) {
+    if (sq_pending == 0)
+        return 0;
+
+    std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + sq_pending, std::memory_order_release);
+    unsigned n = sq_pending;
+    sq_pending = 0;
+
+    int result = sys_io_uring_enter(ring_fd, n, 0, 0, NULL, 0);
+    if (result < 0)
+        return -NetworkEngine::get_error_code();
+    return result;
+}
+
+
+/***
+ * Submits all prepared SQEs and waits for at least n completions, or until
+ * timeout_ms milliseconds have passed. Returns the number of submitted SQEs,
+ * or -errno (-ETIME on timeout, -EINTR on signals).
+ */
+int NetworkUring::submit_and_wait(unsigned int n, long timeout_ms) {
+    unsigned submitted = sq_pending;
+    if (sq_pending > 0) {
+        std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + sq_pending, std::memory_order_release);
+        sq_pending = 0;
+    }
+
+    struct __kernel_timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 * 1000 };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    int result = sys_io_uring_enter(ring_fd, submitted, n, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (result < 0)
+        return -NetworkEngine::get_error_code();
+    return result;
+}
+
+
+} // namespace net
+
+#endif // (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
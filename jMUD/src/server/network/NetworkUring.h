@@ -0,0 +1,134 @@
+/******************************************************************************
+ * file: NetworkUring.h
+ *
+ * description: A minimal io_uring wrapper, talking directly to the kernel
+ *              through io_uring_setup(2)/io_uring_enter(2)/io_uring_register(2)
+ *              so we don't add a dependency on liburing. It only implements
+ *              what NetworkEngine needs: multishot recv with a provided buffer
+ *              ring, multishot poll, cancellation and batched submission.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef NETWORKURING_H
+#define NETWORKURING_H
+
+#include "config.h"
+#include "NetworkCore.h"
+
+#if (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+
+#include <linux/io_uring.h>
+#include <atomic>           // std::atomic_ref
+
+
+namespace net {
+
+
+class NetworkUring {
+public:
+    NetworkUring(void);
+    ~NetworkUring(void);
+
+    bool setup(unsigned int entries);
+    bool setup_buffer_ring(uint16_t group, unsigned int count, unsigned int size);
+
+    // Submission. get_sqe() returns NULL if the submission queue is full, in which case submit() has to be
+    // called before trying again.
+    struct io_uring_sqe* get_sqe(void);
+    bool prepare_recv_multishot(SOCKET s, uint64_t user_data);
+    bool prepare_poll_multishot(int fd, uint64_t user_data);
+    bool prepare_cancel(uint64_t user_data);
+
+    int  submit(void);                                  // Submit without waiting.
+    int  submit_and_wait(unsigned int n, long timeout_ms);   // Submit and wait for n completions.
+
+    // Completion. Use peek_cqe() and cq_advance() to consume completions in batches.
+    struct io_uring_cqe* peek_cqe(unsigned int i);
+    unsigned int         cq_ready(void);
+    void                 cq_advance(unsigned int n);
+
+    // Provided buffers.
+    char* buffer(uint16_t bid) {return buffers + static_cast<std::size_t>(bid) * buffer_size;}
+    void  buffer_recycle(uint16_t bid);                 // Queue a buffer to be handed back to the kernel.
+    void  buffer_commit(void);                          // Hand all queued buffers back in one go.
+
+    static bool is_supported(void);
+
+private:
+    NetworkUring(const NetworkUring&);
+    NetworkUring& operator=(const NetworkUring&);
+
+    int ring_fd;
+
+    // Submission queue.
+    void*     sq_ptr;
+    std::size_t sq_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned  sq_pending;       // SQEs prepared since the last submit().
+    struct io_uring_sqe* sqes;
+    std::size_t sqes_size;
+
+    // Completion queue.
+    void*     cq_ptr;
+    std::size_t cq_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // Provided buffer ring.
+    struct io_uring_buf_ring* buf_ring;
+    std::size_t buf_ring_size;
+    unsigned    buf_ring_mask;
+    unsigned    buf_ring_pending;
+    uint16_t    buf_group;
+    char*       buffers;
+    std::size_t buffer_size;
+    std::size_t buffer_count;
+};
+
+
+inline unsigned int NetworkUring::cq_ready(void) {
+    return std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire) - *cq_head;
+}
+
+
+inline struct io_uring_cqe* NetworkUring::peek_cqe(unsigned int i) {
+    return &cqes[(*cq_head + i) & *cq_mask];
+}
+
+
+inline void NetworkUring::cq_advance(unsigned int n) {
+    std::atomic_ref<unsigned>(*cq_head).store(*cq_head + n, std::memory_order_release);
+}
+
+
+inline void NetworkUring::buffer_recycle(uint16_t bid) {
+    // NOTE: Don't use buf_ring->bufs, the flexible array member inside the union is placed after an empty
+    //       struct by g++ (offset 8 instead of 0) when compiled as C++.
+    struct io_uring_buf* b = reinterpret_cast<struct io_uring_buf*>(buf_ring) + ((buf_ring->tail + buf_ring_pending) & buf_ring_mask);
+    b->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    b->len  = static_cast<uint32_t>(buffer_size);
+    b->bid  = bid;
+    ++buf_ring_pending;
+}
+
+
+inline void NetworkUring::buffer_commit(void) {
+    if (buf_ring_pending == 0)
+        return;
+    uint16_t tail = static_cast<uint16_t>(buf_ring->tail + buf_ring_pending);
+    std::atomic_ref<uint16_t>(buf_ring->tail).store(tail, std::memory_order_release);
+    buf_ring_pending = 0;
+}
+
+
+} // namespace net
+
+#endif // (NETWORK_POLLING == NETWORK_POLLING_USE_IO_URING)
+
+#endif // NETWORKURING_H
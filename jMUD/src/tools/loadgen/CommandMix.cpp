@@ -0,0 +1,93 @@
+/******************************************************************************
+ * file: CommandMix.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "CommandMix.h"
+
+#include <algorithm>    // std::upper_bound()
+#include <cstdlib>      // strtoul()
+#include <fstream>      // std::ifstream
+#include <iostream>     // std::cerr
+
+
+namespace loadgen {
+
+
+CommandMix::CommandMix(void) :
+    _commands(),
+    _cumulative(),
+    _total(0)
+{
+}
+
+
+bool CommandMix::load(const char* filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open the script '" << filename << "'." << std::endl;
+        return false;
+    }
+
+    std::string line;
+    unsigned int n = 0;
+    while (std::getline(file, line)) {
+        ++n;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        const char* p = line.c_str();
+        char* end = NULL;
+        unsigned long weight = strtoul(p, &end, 10);
+        if (end == p || (*end != ' ' && *end != '\t')) {
+            std::cerr << filename << ":" << n << ": expected '<weight> <command>'." << std::endl;
+            return false;
+        }
+        while (*end == ' ' || *end == '\t')
+            ++end;
+        if (*end == '\0') {
+            std::cerr << filename << ":" << n << ": no command after the weight." << std::endl;
+            return false;
+        }
+        add(static_cast<unsigned int>(weight), end);
+    }
+    return true;
+}
+
+
+void CommandMix::add(unsigned int weight, const std::string& command) {
+    if (weight == 0)
+        return;
+
+    _total += weight;
+    _commands.push_back(command);
+    _cumulative.push_back(_total);
+}
+
+
+void CommandMix::add_defaults(void) {
+    add(30, "look");
+    add(10, "north");
+    add(10, "south");
+    add(10, "east");
+    add(10, "west");
+    add(10, "say Anyone up for an adventure?");
+    add(5, "who");
+    add(5, "score");
+    add(5, "inventory");
+    add(5, "examine statue");
+}
+
+
+const std::string& CommandMix::pick(uint64_t random) const {
+    uint64_t at = random % _total;
+    std::size_t i = std::upper_bound(_cumulative.begin(), _cumulative.end(), at) - _cumulative.begin();
+    return _commands[i];
+}
+
+
+} // namespace loadgen
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * file: CommandMix.h
+ *
+ * description: The commands jmud-loadgen sends, each with a weight giving how
+ *              often it is picked relative to the others. A script has one
+ *              command per line, as "<weight> <command>". Empty lines and
+ *              lines starting with '#' are skipped.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef COMMANDMIX_H
+#define COMMANDMIX_H
+
+#include "config.h"
+
+#include <cstdint>      // uint64_t
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+
+namespace loadgen {
+
+
+class CommandMix {
+  public:
+    CommandMix(void);
+
+    bool load(const char* filename);    // Adds the commands of the script.
+    void add(unsigned int weight, const std::string& command);
+    void add_defaults(void);            // A mix of looking around, moving and chatting.
+
+    bool        empty(void) const {return _total == 0;}
+    std::size_t size(void) const {return _commands.size();}
+    const std::string& pick(uint64_t random) const;     // Picks a command by weight, random is any value.
+
+  private:
+    std::vector<std::string> _commands;
+    std::vector<uint64_t>    _cumulative;   // Sum of the weights up to and including each command.
+    uint64_t                 _total;
+};
+
+
+} // namespace loadgen
+
+#endif // COMMANDMIX_H
@@ -0,0 +1,807 @@
+/******************************************************************************
+ * file: LoadGenerator.cpp
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "LoadGenerator.h"
+#include "../../server/network/NetworkTelnet.h"
+
+#include <algorithm>        // std::min(), std::max()
+#include <atomic>           // std::atomic<T>
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdio>           // printf()
+#include <cstring>          // memset(), memcpy(), strerror()
+#include <deque>            // std::deque
+#include <iostream>         // std::cerr
+#include <mutex>            // std::mutex
+#include <queue>            // std::priority_queue
+#include <random>           // std::mt19937_64, std::exponential_distribution
+#include <string>           // std::string
+#include <thread>           // std::thread
+
+#include <errno.h>
+#include <netdb.h>          // getaddrinfo()
+#include <netinet/in.h>     // IPPROTO_TCP
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <signal.h>         // signal()
+#include <sys/epoll.h>      // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/resource.h>   // getrlimit(), setrlimit()
+#include <unistd.h>         // close()
+#include <zlib.h>           // inflate()
+
+
+namespace loadgen {
+
+
+namespace telnet = net::telnet;
+typedef std::chrono::steady_clock Clock;
+
+
+namespace {
+
+std::atomic<bool> interrupted(false);
+
+void interrupt_handler(int) {
+    interrupted.store(true);
+}
+
+double to_ms(uint64_t us) {
+    return static_cast<double>(us) / 1000.0;
+}
+
+} // namespace
+
+
+LoadOptions::LoadOptions(void) :
+    host("127.0.0.1"),
+    port(5000),
+    connections(1000),
+    connect_rate(500.0),
+    command_rate(1.0),
+    duration(30),
+    threads(2),
+    report_interval(5),
+    use_mccp2(false)
+{
+}
+
+
+LoadStats::LoadStats(void) :
+    connected(0), failed(0), closed(0), sent(0), answered(0), bytes_in(0), bytes_out(0), rtt(), connect()
+{
+}
+
+
+void LoadStats::add(const LoadStats& s) {
+    connected += s.connected;
+    failed += s.failed;
+    closed += s.closed;
+    sent += s.sent;
+    answered += s.answered;
+    bytes_in += s.bytes_in;
+    bytes_out += s.bytes_out;
+    rtt.add(s.rtt);
+    connect.add(s.connect);
+}
+
+
+// One thread and its share of the connections. Everything but collect(), open() and stop() is only touched
+// by the thread itself.
+class LoadGenerator::Worker {
+  public:
+    Worker(const LoadOptions& options, const CommandMix& mix, const struct sockaddr_storage& addr, socklen_t addrSize,
+           unsigned int connections, double connectRate, uint64_t seed);
+    ~Worker(void);
+
+    bool start(void);
+    void stop(void) {stopping.store(true, std::memory_order_relaxed);}
+    void join(void) {if (t != NULL && t->joinable()) t->join();}
+
+    void     collect(LoadStats& s);     // Adds what was measured since the last call to s.
+    uint64_t open(void) const {return n_open.load(std::memory_order_relaxed);}
+    uint64_t unanswered(void) const {return n_unanswered;}     // Only once joined.
+
+  private:
+    Worker(const Worker&);
+    Worker& operator=(const Worker&);
+
+    enum State : uint8_t {Connecting, Open, Closed};
+    enum TelnetState : uint8_t {Data, Iac, Option, SbOption, Sb, SbIac};
+
+    struct Client {
+        int         fd;
+        State       state;
+        TelnetState telnet;
+        uint8_t     command;        // WILL/WONT/DO/DONT waiting for its option.
+        uint8_t     sb_option;      // Option of the subnegotiation we're in.
+        bool        mccp;           // We agreed to MCCP2, compressed output follows its start sequence.
+        bool        write_wait;     // Waiting for the socket to become writable.
+        Clock::time_point connecting;
+        std::string out;            // Output not written yet.
+        std::deque<Clock::time_point> outstanding;  // When the unanswered commands were due, oldest first.
+        z_stream*   z;
+    };
+
+    typedef std::pair<Clock::time_point, std::size_t> Due;     // When the next command of a client is due.
+
+    void exec(void);
+    void handle(const struct epoll_event& event);
+    void open_connection(Clock::time_point now);
+    void connected(Client& c);
+    void close_connection(Client& c, bool byServer);
+    void send_command(std::size_t i, Clock::time_point due);
+    void write(Client& c);
+    void read(Client& c);
+    void input(Client& c, const char* data, std::size_t length, Clock::time_point now);
+    std::size_t telnet(Client& c, const char* data, std::size_t length, Clock::time_point now);
+    void negotiate(Client& c, uint8_t command, uint8_t option, Clock::time_point now);
+    bool start_compression(Client& c);
+    void stop_compression(Client& c);
+    void watch(Client& c, bool writable);
+    Clock::duration next_interval(void);
+
+    const LoadOptions&             options;
+    const CommandMix&              mix;
+    const struct sockaddr_storage& addr;
+    socklen_t                      addr_size;
+
+    unsigned int    n_connections;
+    Clock::duration connect_interval;
+
+    std::thread*      t;
+    std::atomic<bool> stopping;
+    int               epoll_fd;
+
+    std::vector<Client> clients;    // NOTE: Reserved up front, the index of a client never changes.
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due> > schedule;
+    std::mt19937_64 random;
+    std::exponential_distribution<double> intervals;
+
+    std::atomic<uint64_t> n_open;
+    uint64_t n_outstanding;
+    uint64_t n_unanswered;
+    bool     warned;
+
+    std::mutex mutex;   // Protects stats.
+    LoadStats  stats;
+};
+
+
+LoadGenerator::Worker::Worker(const LoadOptions& o, const CommandMix& m, const struct sockaddr_storage& a, socklen_t addrSize,
+                              unsigned int connections, double connectRate, uint64_t seed) :
+    options(o),
+    mix(m),
+    addr(a),
+    addr_size(addrSize),
+    n_connections(connections),
+    connect_interval(Clock::duration::zero()),
+    t(NULL),
+    stopping(false),
+    epoll_fd(-1),
+    clients(),
+    schedule(),
+    random(seed),
+    intervals((o.command_rate > 0) ? o.command_rate : 1.0),
+    n_open(0),
+    n_outstanding(0),
+    n_unanswered(0),
+    warned(false),
+    mutex(),
+    stats()
+{
+    if (connectRate > 0)
+        connect_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / connectRate));
+    clients.reserve(connections);
+}
+
+
+LoadGenerator::Worker::~Worker(void) {
+    join();
+    delete t;
+    if (epoll_fd != -1)
+        ::close(epoll_fd);
+}
+
+
+bool LoadGenerator::Worker::start(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        std::cerr << "Failed to create an epoll file descriptor (" << strerror(errno) << ")." << std::endl;
+        return false;
+    }
+
+    t = new std::thread(&LoadGenerator::Worker::exec, this);
+    return true;
+}
+
+
+void LoadGenerator::Worker::collect(LoadStats& s) {
+    std::lock_guard<std::mutex> lock(mutex);
+    s.add(stats);
+    stats = LoadStats();
+}
+
+
+/***
+ * Opens the connections at the connect rate, sends every connection's
+ * commands as they fall due and handles what the server sends back, until
+ * stopped. Then waits DrainTimeout ms at the most for the last answers,
+ * before closing all connections.
+ */
+void LoadGenerator::Worker::exec(void) {
+    struct epoll_event events[256];
+    Clock::time_point next_connect = Clock::now();
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        Clock::time_point now = Clock::now();
+
+        // NOTE: If we fell behind we catch up, so the connect rate holds on average.
+        while (clients.size() < n_connections && next_connect <= now) {
+            open_connection(now);
+            next_connect += connect_interval;
+        }
+
+        while (!schedule.empty() && schedule.top().first <= now) {
+            Due due = schedule.top();
+            schedule.pop();
+            send_command(due.second, due.first);
+        }
+
+        Clock::time_point wakeup = now + std::chrono::milliseconds(100);
+        if (clients.size() < n_connections)
+            wakeup = std::min(wakeup, next_connect);
+        if (!schedule.empty())
+            wakeup = std::min(wakeup, schedule.top().first);
+        int timeout = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(wakeup - now).count());
+
+        int eventCount = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), std::max(timeout, 0));
+        for (int i = 0; i < eventCount; i++) {
+            handle(events[i]);
+        }
+    }
+
+    int drainTimeout = DrainTimeout;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(drainTimeout);
+    while (n_outstanding > 0 && Clock::now() < deadline) {
+        int eventCount = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), 10);
+        for (int i = 0; i < eventCount; i++) {
+            handle(events[i]);
+        }
+    }
+
+    for (Client& c: clients) {
+        close_connection(c, false);
+    }
+}
+
+
+void LoadGenerator::Worker::handle(const struct epoll_event& event) {
+    Client& c = clients[event.data.u64];
+
+    if (c.state == Connecting) {
+        connected(c);
+        return;
+    }
+    if (c.state == Open && (event.events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        read(c);
+    if (c.state == Open && (event.events & EPOLLOUT))
+        write(c);
+}
+
+
+void LoadGenerator::Worker::open_connection(Clock::time_point now) {
+    clients.push_back(Client());
+    Client& c = clients.back();
+    c.fd = -1;
+    c.state = Closed;
+    c.telnet = Data;
+    c.command = 0;
+    c.sb_option = 0;
+    c.mccp = false;
+    c.write_wait = true;
+    c.connecting = now;
+    c.z = NULL;
+
+    c.fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd == -1 || (connect(c.fd, reinterpret_cast<const struct sockaddr*>(&addr), addr_size) == -1 && errno != EINPROGRESS)) {
+        if (!warned) {
+            std::cerr << "Failed to open a connection (" << strerror(errno) << "), there may be more." << std::endl;
+            warned = true;
+        }
+        if (c.fd != -1)
+            ::close(c.fd);
+        c.fd = -1;
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.failed;
+        return;
+    }
+
+    // NOTE: Commands are small and sent one at a time, as by a player's client.
+    int on = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.u64 = clients.size() - 1;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c.fd, &event);
+    c.state = Connecting;
+}
+
+
+void LoadGenerator::Worker::connected(Client& c) {
+    int error = 0;
+    socklen_t size = sizeof(error);
+    if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &size) == -1 || error != 0) {
+        if (!warned) {
+            std::cerr << "Failed to connect (" << strerror((error != 0) ? error : errno) << "), there may be more." << std::endl;
+            warned = true;
+        }
+        ::close(c.fd);
+        c.state = Closed;
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.failed;
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    c.state = Open;
+    n_open.fetch_add(1, std::memory_order_relaxed);
+    watch(c, false);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.connected;
+        stats.connect.record(std::chrono::duration_cast<std::chrono::microseconds>(now - c.connecting).count());
+    }
+
+    // NOTE: The first command comes anywhere within one interval, so the connections don't all send in step.
+    if (options.command_rate > 0) {
+        std::uniform_real_distribution<double> first(0.0, 1.0 / options.command_rate);
+        Clock::duration delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(first(random)));
+        schedule.push(Due(now + delay, &c - &clients[0]));
+    }
+}
+
+
+void LoadGenerator::Worker::close_connection(Client& c, bool byServer) {
+    if (c.state == Closed)
+        return;
+
+    if (c.state == Open)
+        n_open.fetch_sub(1, std::memory_order_relaxed);
+    n_outstanding -= c.outstanding.size();
+    n_unanswered += c.outstanding.size();
+    c.outstanding.clear();
+    c.out.clear();
+    stop_compression(c);
+
+    ::close(c.fd);
+    c.fd = -1;
+    c.state = Closed;
+
+    if (byServer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.closed;
+    }
+}
+
+
+/***
+ * Queues the next command of the client, followed by IAC DO TIMING-MARK for
+ * the server to answer, and schedules the one after it. The next one is due
+ * an exponentially distributed interval after this one was due, so the
+ * commands of each client arrive as a Poisson process at the command rate.
+ */
+void LoadGenerator::Worker::send_command(std::size_t i, Clock::time_point due) {
+    Client& c = clients[i];
+    if (c.state != Open)
+        return;
+
+    const char mark[] = {static_cast<char>(telnet::IAC), static_cast<char>(telnet::DO), static_cast<char>(telnet::TM)};
+    c.out.append(mix.pick(random()));
+    c.out.append("\r\n");
+    c.out.append(mark, sizeof(mark));
+    c.outstanding.push_back(due);
+    ++n_outstanding;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.sent;
+    }
+
+    schedule.push(Due(due + next_interval(), i));
+    if (!c.write_wait)
+        write(c);
+}
+
+
+void LoadGenerator::Worker::write(Client& c) {
+    std::size_t written = 0;
+    while (written < c.out.size()) {
+        ssize_t result = send(c.fd, c.out.data() + written, c.out.size() - written, MSG_NOSIGNAL);
+        if (result > 0) {
+            written += result;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            close_connection(c, true);
+            return;
+        }
+    }
+
+    c.out.erase(0, written);
+    watch(c, !c.out.empty());
+    if (written > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.bytes_out += written;
+    }
+}
+
+
+void LoadGenerator::Worker::read(Client& c) {
+    char buffer[16384];
+    std::size_t total = 0;
+
+    while (c.state == Open) {
+        ssize_t result = recv(c.fd, buffer, sizeof(buffer), 0);
+        if (result > 0) {
+            total += result;
+            input(c, buffer, result, Clock::now());
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            close_connection(c, true);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.bytes_in += total;
+}
+
+
+/***
+ * Passes what the server sent through the Telnet decoder, inflating it first
+ * once MCCP2 has started. The start sequence can be anywhere in a read, so
+ * the rest of the read after it is inflated.
+ */
+void LoadGenerator::Worker::input(Client& c, const char* data, std::size_t length, Clock::time_point now) {
+    while (length > 0 && c.state == Open) {
+        if (c.z == NULL) {
+            std::size_t used = telnet(c, data, length, now);
+            data += used;
+            length -= used;
+            continue;
+        }
+
+        char plain[16384];
+        c.z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        c.z->avail_in = static_cast<uInt>(length);
+        c.z->next_out = reinterpret_cast<Bytef*>(plain);
+        c.z->avail_out = sizeof(plain);
+        int result = inflate(c.z, Z_SYNC_FLUSH);
+
+        std::size_t used = length - c.z->avail_in;
+        std::size_t produced = sizeof(plain) - c.z->avail_out;
+        data += used;
+        length -= used;
+        if (produced > 0)
+            telnet(c, plain, produced, now);
+
+        if (result == Z_STREAM_END) {
+            // The server ended the compression, what follows is plain again.
+            stop_compression(c);
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+            std::cerr << "Failed to inflate the server's output (" << result << "), closing the connection." << std::endl;
+            close_connection(c, false);
+        } else if (used == 0 && produced == 0) {
+            break;
+        }
+    }
+}
+
+
+/***
+ * Decodes the Telnet commands in the data, the text around them is only
+ * counted. Returns how much of the data was decoded, which is all of it but
+ * when MCCP2 starts, then decoding stops right after the start sequence.
+ */
+std::size_t LoadGenerator::Worker::telnet(Client& c, const char* data, std::size_t length, Clock::time_point now) {
+    for (std::size_t i = 0; i < length; i++) {
+        uint8_t b = static_cast<uint8_t>(data[i]);
+
+        switch (c.telnet) {
+        case Data:
+            if (b == telnet::IAC)
+                c.telnet = Iac;
+            break;
+        case Iac:
+            if (b >= telnet::WILL && b <= telnet::DONT) {
+                c.command = b;
+                c.telnet = Option;
+            } else if (b == telnet::SB) {
+                c.telnet = SbOption;
+            } else {
+                // IAC IAC is a data byte, anything else a command without an option.
+                c.telnet = Data;
+            }
+            break;
+        case Option:
+            c.telnet = Data;
+            negotiate(c, c.command, b, now);
+            if (c.state != Open)
+                return length;
+            break;
+        case SbOption:
+            c.sb_option = b;
+            c.telnet = Sb;
+            break;
+        case Sb:
+            if (b == telnet::IAC)
+                c.telnet = SbIac;
+            break;
+        case SbIac:
+            if (b != telnet::SE) {
+                c.telnet = Sb;
+                break;
+            }
+            c.telnet = Data;
+            // NOTE: Everything after IAC SB COMPRESS2 IAC SE is compressed.
+            if (c.sb_option == telnet::COMPRESS2 && c.mccp && c.z == NULL) {
+                if (start_compression(c) == false) {
+                    close_connection(c, false);
+                    return length;
+                }
+                return i + 1;
+            }
+            break;
+        }
+    }
+    return length;
+}
+
+
+/***
+ * A WILL or WONT TIMING-MARK answers the oldest command not answered yet. The
+ * server's offer of MCCP2 is accepted if asked to, everything else refused.
+ */
+void LoadGenerator::Worker::negotiate(Client& c, uint8_t command, uint8_t option, Clock::time_point now) {
+    char reply[3] = {static_cast<char>(telnet::IAC), 0, static_cast<char>(option)};
+
+    switch (command) {
+    case telnet::WILL:
+    case telnet::WONT:
+        if (option == telnet::TM) {
+            if (c.outstanding.empty())
+                return;
+            uint64_t rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - c.outstanding.front()).count();
+            c.outstanding.pop_front();
+            --n_outstanding;
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.answered;
+            stats.rtt.record(rtt);
+            return;
+        }
+        if (command == telnet::WONT)
+            return;
+        c.mccp = (option == telnet::COMPRESS2 && options.use_mccp2);
+        reply[1] = static_cast<char>(c.mccp ? telnet::DO : telnet::DONT);
+        break;
+    case telnet::DO:
+        reply[1] = static_cast<char>(telnet::WONT);
+        break;
+    default:
+        return;
+    }
+
+    c.out.append(reply, sizeof(reply));
+    if (!c.write_wait)
+        write(c);
+}
+
+
+bool LoadGenerator::Worker::start_compression(Client& c) {
+    c.z = new z_stream;
+    memset(c.z, 0, sizeof(z_stream));
+    if (inflateInit(c.z) != Z_OK) {
+        std::cerr << "Failed to initialize zlib for MCCP2." << std::endl;
+        delete c.z;
+        c.z = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+void LoadGenerator::Worker::stop_compression(Client& c) {
+    if (c.z == NULL)
+        return;
+    inflateEnd(c.z);
+    delete c.z;
+    c.z = NULL;
+}
+
+
+void LoadGenerator::Worker::watch(Client& c, bool writable) {
+    if (c.write_wait == writable)
+        return;
+
+    struct epoll_event event;
+    event.events = writable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.u64 = &c - &clients[0];
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &event);
+    c.write_wait = writable;
+}
+
+
+Clock::duration LoadGenerator::Worker::next_interval(void) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(intervals(random)));
+}
+
+
+LoadGenerator::LoadGenerator(const LoadOptions& o, const CommandMix& m) :
+    options(o),
+    mix(m),
+    workers(),
+    addr(),
+    addr_size(0)
+{
+}
+
+
+LoadGenerator::~LoadGenerator(void) {
+    for (Worker* w: workers) {
+        delete w;
+    }
+}
+
+
+/***
+ * Runs the load for as long as it takes to open all connections, and then
+ * for the duration. Reports every report interval and once done. Stops early,
+ * with the final report, on SIGINT.
+ */
+int LoadGenerator::run(void) {
+    if (options.connections == 0 || mix.empty()) {
+        std::cerr << "Nothing to do, no connections or no commands." << std::endl;
+        return -1;
+    }
+    if (resolve() == false)
+        return -1;
+    raise_fd_limit();
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, interrupt_handler);
+
+    unsigned int threads = std::max(1u, std::min(options.threads, options.connections));
+    printf("Opening %u connection(s) to %s port %u at %.0f/s, %.2f command(s)/s each from a mix of %lu, %u thread(s), for %u s.\n",
+            options.connections, options.host, options.port, options.connect_rate, options.command_rate, mix.size(), threads, options.duration);
+
+    std::random_device seed;
+    for (unsigned int i = 0; i < threads; i++) {
+        unsigned int share = options.connections / threads + ((i < options.connections % threads) ? 1 : 0);
+        double rate = options.connect_rate * share / options.connections;
+        Worker* w = new Worker(options, mix, addr, addr_size, share, rate, (static_cast<uint64_t>(seed()) << 32) | seed());
+        workers.push_back(w);
+        if (w->start() == false)
+            return -1;
+    }
+
+    double ramp = (options.connect_rate > 0) ? options.connections / options.connect_rate : 0.0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ramp + options.duration));
+    Clock::time_point last = start;
+    int reportInterval = static_cast<int>(options.report_interval);
+    LoadStats total;
+
+    while (last < end && !interrupted.load()) {
+        Clock::time_point next = (reportInterval > 0) ? std::min(last + std::chrono::seconds(reportInterval), end) : end;
+        while (Clock::now() < next && !interrupted.load()) {
+            std::this_thread::sleep_for(std::min<Clock::duration>(next - Clock::now(), std::chrono::milliseconds(100)));
+        }
+        Clock::time_point now = Clock::now();
+
+        LoadStats s;
+        uint64_t open = 0;
+        for (Worker* w: workers) {
+            w->collect(s);
+            open += w->open();
+        }
+        total.add(s);
+        if (reportInterval > 0)
+            report(s, std::chrono::duration<double>(now - start).count(), std::chrono::duration<double>(now - last).count(), open);
+        last = now;
+    }
+
+    for (Worker* w: workers) {
+        w->stop();
+    }
+    uint64_t unanswered = 0;
+    for (Worker* w: workers) {
+        w->join();
+        w->collect(total);
+        unanswered += w->unanswered();
+    }
+
+    report_total(total, std::chrono::duration<double>(last - start).count(), unanswered);
+    return (total.connected > 0) ? 0 : -1;
+}
+
+
+bool LoadGenerator::resolve(void) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result = NULL;
+    std::string port = std::to_string(options.port);
+    int error = getaddrinfo(options.host, port.c_str(), &hints, &result);
+    if (error != 0 || result == NULL) {
+        std::cerr << "Failed to look up '" << options.host << "' (" << gai_strerror(error) << ")." << std::endl;
+        return false;
+    }
+
+    memcpy(&addr, result->ai_addr, result->ai_addrlen);
+    addr_size = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+
+/***
+ * Every connection takes a file descriptor, far more than the usual soft
+ * limit when there are thousands of them. Raises it as far as the hard limit
+ * allows.
+ */
+void LoadGenerator::raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return;
+
+    rlim_t needed = options.connections + 64;
+    if (limit.rlim_cur >= needed)
+        return;
+
+    limit.rlim_cur = (limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= needed) ? needed : limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < needed) {
+        std::cerr << "Only " << limit.rlim_cur << " file descriptors allowed, not all connections can be opened "
+                  << "(raise the hard limit with 'ulimit -Hn')." << std::endl;
+    }
+}
+
+
+void LoadGenerator::report(const LoadStats& s, double elapsed, double seconds, uint64_t open) {
+    if (seconds <= 0)
+        return;
+
+    printf("%7.1f s: %6lu open, %8.1f cmd/s sent, %8.1f answered, rtt p50 %.2f ms, p99 %.2f ms, p999 %.2f ms, max %.2f ms, in %.1f KiB/s, out %.1f KiB/s\n",
+            elapsed, open, s.sent / seconds, s.answered / seconds,
+            to_ms(s.rtt.percentile(50)), to_ms(s.rtt.percentile(99)), to_ms(s.rtt.percentile(99.9)), to_ms(s.rtt.max()),
+            s.bytes_in / 1024.0 / seconds, s.bytes_out / 1024.0 / seconds);
+    fflush(stdout);
+}
+
+
+void LoadGenerator::report_total(const LoadStats& s, double seconds, uint64_t unanswered) {
+    if (seconds <= 0)
+        seconds = 1;
+
+    printf("\n");
+    printf("Connections: %lu opened, %lu failed, %lu closed by the server.\n", s.connected, s.failed, s.closed);
+    printf("Connect:     p50 %.2f ms, p99 %.2f ms, p999 %.2f ms, max %.2f ms\n",
+            to_ms(s.connect.percentile(50)), to_ms(s.connect.percentile(99)), to_ms(s.connect.percentile(99.9)), to_ms(s.connect.max()));
+    printf("Commands:    %lu sent, %lu answered, %lu unanswered (%.1f answered/s over %.1f s)\n",
+            s.sent, s.answered, unanswered, s.answered / seconds, seconds);
+    printf("Round-trip:  mean %.2f ms, p50 %.2f ms, p99 %.2f ms, p999 %.2f ms, max %.2f ms\n",
+            to_ms(s.rtt.mean()), to_ms(s.rtt.percentile(50)), to_ms(s.rtt.percentile(99)), to_ms(s.rtt.percentile(99.9)), to_ms(s.rtt.max()));
+    printf("Traffic:     in %.1f KiB (%.1f KiB/s), out %.1f KiB (%.1f KiB/s)\n",
+            s.bytes_in / 1024.0, s.bytes_in / 1024.0 / seconds, s.bytes_out / 1024.0, s.bytes_out / 1024.0 / seconds);
+}
+
+
+} // namespace loadgen
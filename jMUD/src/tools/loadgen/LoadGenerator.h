@@ -0,0 +1,102 @@
+/******************************************************************************
+ * file: LoadGenerator.h
+ *
+ * description: Loopback load generator for NetworkEngine. Opens a number of
+ *              telnet connections to a running server, spread over a few
+ *              threads with an epoll set each, and has every connection send
+ *              commands picked from a CommandMix at a given rate. Each command
+ *              is followed by IAC DO TIMING-MARK (RFC 860), which the server
+ *              answers as soon as a recv-thread has decoded the input, and the
+ *              time until the answer arrives is the command's round-trip.
+ *
+ *              The commands go out on schedule whether or not the ones before
+ *              them have been answered, and the round-trip is counted from the
+ *              time a command was due, not when it got written. A server that
+ *              falls behind shows up in the latencies, it doesn't slow down
+ *              the load.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include "config.h"
+#include "CommandMix.h"
+#include "Histogram.h"
+
+#include <cstdint>      // uint64_t
+#include <vector>       // std::vector
+
+#include <sys/socket.h> // struct sockaddr_storage, socklen_t
+
+
+namespace loadgen {
+
+
+struct LoadOptions {
+    LoadOptions(void);
+
+    const char*  host;
+    uint16_t     port;
+    unsigned int connections;
+    double       connect_rate;      // New connections per second, all threads together.
+    double       command_rate;      // Commands per second and connection, on average.
+    unsigned int duration;          // Seconds of load once all connections have been opened.
+    unsigned int threads;
+    unsigned int report_interval;   // Seconds between reports, 0 for only the final one.
+    bool         use_mccp2;         // Accept the server's offer to compress its output.
+};
+
+
+// What was measured, over a report interval or the whole run. Times in microseconds.
+struct LoadStats {
+    LoadStats(void);
+
+    void add(const LoadStats& s);
+
+    uint64_t  connected;
+    uint64_t  failed;       // Connections that couldn't be opened.
+    uint64_t  closed;       // Connections closed by the server.
+    uint64_t  sent;         // Commands.
+    uint64_t  answered;
+    uint64_t  bytes_in;
+    uint64_t  bytes_out;
+    Histogram rtt;
+    Histogram connect;
+};
+
+
+class LoadGenerator {
+  public:
+    // NOTE: A round-trip not done DrainTimeout ms after the load stops counts as unanswered.
+    static const int DrainTimeout = 2000;
+
+    LoadGenerator(const LoadOptions& options, const CommandMix& mix);
+    ~LoadGenerator(void);
+
+    int run(void);
+
+  private:
+    LoadGenerator(const LoadGenerator&);
+    LoadGenerator& operator=(const LoadGenerator&);
+
+    class Worker;
+
+    bool resolve(void);
+    void raise_fd_limit(void);
+    void report(const LoadStats& s, double elapsed, double seconds, uint64_t open);
+    void report_total(const LoadStats& s, double seconds, uint64_t unanswered);
+
+    const LoadOptions&   options;
+    const CommandMix&    mix;
+    std::vector<Worker*> workers;
+
+    struct sockaddr_storage addr;
+    socklen_t               addr_size;
+};
+
+
+} // namespace loadgen
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,96 @@
+/******************************************************************************
+ * file: main.cpp
+ *
+ * description: jmud-loadgen, puts a running jMUD server under the load of
+ *              many simulated telnet clients. See LoadGenerator.h.
+ *
+ * created: 2026-10-17 by jimmy
+ * authors: jimmy
+ *****************************************************************************/
+#include "config.h"
+#include "CommandMix.h"
+#include "LoadGenerator.h"
+
+#include <cstdlib>      // atoi(), atof()
+#include <cstring>      // strcmp()
+#include <iostream>     // std::cout
+
+
+void printHelp(void) {
+    loadgen::LoadOptions defaults;
+
+    std::cout << "jmud-loadgen v0.0.1-alpha" << std::endl << std::endl;
+    std::cout << " Usage: jmud-loadgen [options]" << std::endl << std::endl;
+    std::cout << " Options:" << std::endl;
+    std::cout << "  -h, --help              Displays this helptext." << std::endl;
+    std::cout << "  -a, --address <host>    Server to connect to (" << defaults.host << ")." << std::endl;
+    std::cout << "  -p, --port <port>       Port to connect to (" << defaults.port << ")." << std::endl;
+    std::cout << "  -c, --connections <n>   Connections to open (" << defaults.connections << ")." << std::endl;
+    std::cout << "  -o, --open-rate <n>     New connections per second (" << defaults.connect_rate << ")." << std::endl;
+    std::cout << "  -r, --rate <n>          Commands per second and connection (" << defaults.command_rate << ")." << std::endl;
+    std::cout << "  -d, --duration <s>      Seconds of load once all connections are open (" << defaults.duration << ")." << std::endl;
+    std::cout << "  -t, --threads <n>       Threads to spread the connections over (" << defaults.threads << ")." << std::endl;
+    std::cout << "  -i, --interval <s>      Seconds between reports, 0 for only the final one (" << defaults.report_interval << ")." << std::endl;
+    std::cout << "  -s, --script <file>     Commands to send, one '<weight> <command>' per line." << std::endl;
+    std::cout << "  -z, --mccp2             Accept the server's offer to compress its output." << std::endl << std::endl;
+    std::cout << " NOTE: The server limits the input of each connection, a rate above its line limit" << std::endl;
+    std::cout << "       measures the throttling and not the server." << std::endl;
+}
+
+
+int main(int argc, char* argv[]) {
+    loadgen::LoadOptions options;
+    loadgen::CommandMix mix;
+    const char* script = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if ((strcmp(arg, "-h") == 0) || (strcmp(arg, "--help") == 0)) {
+            printHelp();
+            return 0;
+        } else if ((strcmp(arg, "-z") == 0) || (strcmp(arg, "--mccp2") == 0)) {
+            options.use_mccp2 = true;
+            continue;
+        }
+
+        if (value == NULL) {
+            std::cout << "Missing value for argument: '" << arg << "'" << std::endl;
+            return -1;
+        }
+        ++i;
+        if ((strcmp(arg, "-a") == 0) || (strcmp(arg, "--address") == 0)) {
+            options.host = value;
+        } else if ((strcmp(arg, "-p") == 0) || (strcmp(arg, "--port") == 0)) {
+            options.port = static_cast<uint16_t>(atoi(value));
+        } else if ((strcmp(arg, "-c") == 0) || (strcmp(arg, "--connections") == 0)) {
+            options.connections = static_cast<unsigned int>(atoi(value));
+        } else if ((strcmp(arg, "-o") == 0) || (strcmp(arg, "--open-rate") == 0)) {
+            options.connect_rate = atof(value);
+        } else if ((strcmp(arg, "-r") == 0) || (strcmp(arg, "--rate") == 0)) {
+            options.command_rate = atof(value);
+        } else if ((strcmp(arg, "-d") == 0) || (strcmp(arg, "--duration") == 0)) {
+            options.duration = static_cast<unsigned int>(atoi(value));
+        } else if ((strcmp(arg, "-t") == 0) || (strcmp(arg, "--threads") == 0)) {
+            options.threads = static_cast<unsigned int>(atoi(value));
+        } else if ((strcmp(arg, "-i") == 0) || (strcmp(arg, "--interval") == 0)) {
+            options.report_interval = static_cast<unsigned int>(atoi(value));
+        } else if ((strcmp(arg, "-s") == 0) || (strcmp(arg, "--script") == 0)) {
+            script = value;
+        } else {
+            std::cout << "Unknown argument: '" << arg << "'" << std::endl;
+            return -1;
+        }
+    }
+
+    if (script != NULL) {
+        if (mix.load(script) == false)
+            return -1;
+    } else {
+        mix.add_defaults();
+    }
+
+    loadgen::LoadGenerator generator(options, mix);
+    return generator.run();
+}
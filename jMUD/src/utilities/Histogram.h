@@ -0,0 +1,96 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <bit>      // std::bit_width()
+#include <cstddef>  // std::size_t
+#include <cstdint>  // uint64_t
+
+
+
+// A log-linear histogram of unsigned values, for percentiles of latencies and the like. Values below 8 have a
+// bucket each, above that every power of two is split into 8 buckets, so a bucket is never more than 1/8
+// (12.5%) wider than its lower bound. Recording a value is a couple of instructions and no allocation.
+//
+// NOTE: Not thread-safe.
+class Histogram {
+  public:
+    static const std::size_t SubBits = 3;
+    static const std::size_t SubBuckets = std::size_t(1) << SubBits;
+    static const std::size_t Buckets = (64 - SubBits + 1) * SubBuckets;
+
+    Histogram() : _count(0), _sum(0), _max(0), _buckets() {}
+
+    void record(uint64_t value);
+    void add(const Histogram& h);   // Adds all values recorded in h.
+    void clear(void) {*this = Histogram();}
+
+    uint64_t count(void) const {return _count;}
+    uint64_t max(void) const {return _max;}
+    uint64_t mean(void) const {return (_count > 0) ? _sum / _count : 0;}
+    uint64_t percentile(double p) const;    // Upper bound of the bucket the p:th percentile is in.
+
+    static std::size_t bucket(uint64_t value);
+    static uint64_t    bucket_low(std::size_t i);
+    static uint64_t    bucket_high(std::size_t i);
+
+  private:
+    uint64_t _count;
+    uint64_t _sum;
+    uint64_t _max;
+    uint64_t _buckets[Buckets];
+};
+
+
+inline std::size_t Histogram::bucket(uint64_t value) {
+    if (value < SubBuckets)
+        return static_cast<std::size_t>(value);
+    std::size_t shift = std::bit_width(value) - 1 - SubBits;
+    return (shift + 1) * SubBuckets + static_cast<std::size_t>((value >> shift) & (SubBuckets - 1));
+}
+
+inline uint64_t Histogram::bucket_low(std::size_t i) {
+    if (i < SubBuckets)
+        return i;
+    std::size_t shift = i / SubBuckets - 1;
+    return (SubBuckets + i % SubBuckets) << shift;
+}
+
+inline uint64_t Histogram::bucket_high(std::size_t i) {
+    if (i < SubBuckets)
+        return i;
+    return bucket_low(i) + (uint64_t(1) << (i / SubBuckets - 1)) - 1;
+}
+
+inline void Histogram::record(uint64_t value) {
+    ++_buckets[bucket(value)];
+    ++_count;
+    _sum += value;
+    if (value > _max)
+        _max = value;
+}
+
+inline void Histogram::add(const Histogram& h) {
+    for (std::size_t i = 0; i < Buckets; i++)
+        _buckets[i] += h._buckets[i];
+    _count += h._count;
+    _sum += h._sum;
+    if (h._max > _max)
+        _max = h._max;
+}
+
+inline uint64_t Histogram::percentile(double p) const {
+    if (_count == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(_count));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < Buckets; i++) {
+        seen += _buckets[i];
+        if (seen > rank)
+            return (bucket_high(i) < _max) ? bucket_high(i) : _max;
+    }
+    return _max;
+}
+
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,125 @@
+#ifndef QUEUEMPSC_H
+#define QUEUEMPSC_H
+
+#include <cstddef>  // std::size_t
+#include <atomic>   // std::atomic<T>
+
+
+
+// A bounded lock-free multi-producer/single-consumer FIFO ring of N (a power of two) elements. Any number
+// of threads may push() at the same time, but only one thread at a time may pop(). Both come in a batch
+// version that moves as many elements as possible in one go and returns how many it moved.
+//
+// Producers reserve a range of cells by advancing _tail with a single CAS, then fill them and mark each cell
+// as ready with its position. The consumer only reads cells marked ready and publishes its progress through
+// _head, which is also what producers check to see if there's room.
+//
+// NOTE: Only intended for pointers and other trivially copyable types.
+template<typename T, std::size_t N> class QueueMPSC {
+  public:
+    QueueMPSC() : _head(0), _tail(0), _cells() {}
+    ~QueueMPSC() {}
+
+    // Any thread.
+    bool push(T e);
+    std::size_t push(const T* e, std::size_t n);
+
+    // Consumer only.
+    bool pop(T& e);
+    std::size_t pop(T* e, std::size_t n);
+
+    bool empty(void);
+    bool full(void);
+    std::size_t size(void);
+    std::size_t capacity(void) {return N;}
+
+  private:
+    QueueMPSC(const QueueMPSC&);
+    QueueMPSC& operator=(const QueueMPSC&);
+
+    static_assert(N > 0 && (N & (N - 1)) == 0, "QueueMPSC size must be a power of two.");
+    static const std::size_t mask = N - 1;
+
+    struct Cell {
+        Cell() : ready(0), data() {}
+        std::atomic<std::size_t> ready;     // Position + 1 of the element the cell holds, when it is ready.
+        T data;
+    };
+
+    // Keep the consumer and producer positions on separate cache lines.
+    alignas(64) std::atomic<std::size_t> _head;
+    alignas(64) std::atomic<std::size_t> _tail;
+    alignas(64) Cell _cells[N];
+};
+
+template <class T, std::size_t N> inline bool QueueMPSC<T, N>::push(T e) {
+    return push(&e, 1) == 1;
+}
+
+template <class T, std::size_t N> inline std::size_t QueueMPSC<T, N>::push(const T* e, std::size_t n) {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    std::size_t count;
+    for (;;) {
+        std::size_t used = tail - _head.load(std::memory_order_acquire);
+        if (used > N) {
+            // Our tail is stale, the consumer has already passed it.
+            tail = _tail.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        count = (n < N - used) ? n : N - used;
+        if (count == 0) {
+            // Only full if nobody else has pushed since we read the tail.
+            std::size_t current = _tail.load(std::memory_order_relaxed);
+            if (current == tail)
+                return 0;
+            tail = current;
+            continue;
+        }
+
+        if (_tail.compare_exchange_weak(tail, tail + count, std::memory_order_relaxed))
+            break;
+    }
+
+    for (std::size_t i = 0; i < count; i++) {
+        Cell& c = _cells[(tail + i) & mask];
+        c.data = e[i];
+        c.ready.store(tail + i + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+template <class T, std::size_t N> inline bool QueueMPSC<T, N>::pop(T& e) {
+    return pop(&e, 1) == 1;
+}
+
+template <class T, std::size_t N> inline std::size_t QueueMPSC<T, N>::pop(T* e, std::size_t n) {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    std::size_t i = 0;
+    for (; i < n; i++) {
+        Cell& c = _cells[(head + i) & mask];
+        if (c.ready.load(std::memory_order_acquire) != head + i + 1)
+            break;
+        e[i] = c.data;
+    }
+    if (i > 0)
+        _head.store(head + i, std::memory_order_release);
+    return i;
+}
+
+template <class T, std::size_t N> inline bool QueueMPSC<T, N>::empty(void) {
+    return size() == 0;
+}
+
+template <class T, std::size_t N> inline bool QueueMPSC<T, N>::full(void) {
+    return size() >= N;
+}
+
+// NOTE: Only a snapshot, other threads may change it before it is returned.
+template <class T, std::size_t N> inline std::size_t QueueMPSC<T, N>::size(void) {
+    std::size_t head = _head.load(std::memory_order_acquire);
+    std::size_t tail = _tail.load(std::memory_order_acquire);
+    return (tail > head) ? tail - head : 0;
+}
+
+#endif // QUEUEMPSC_H
@@ -0,0 +1,105 @@
+#ifndef QUEUESPSC_H
+#define QUEUESPSC_H
+
+#include <cstddef>  // std::size_t
+#include <atomic>   // std::atomic<T>
+
+
+
+// A bounded lock-free single-producer/single-consumer FIFO ring of N (a power of two) elements. Cheaper than
+// QueueMPSC since neither side ever needs a CAS, but only one thread at a time may push() and only one
+// thread at a time may pop(). Both come in a batch version, returning how many elements were moved.
+//
+// Each side keeps a cached copy of the other side's position, so it only touches the other side's cache
+// line when the cached value says the ring is full (or empty).
+//
+// NOTE: Only intended for pointers and other trivially copyable types.
+template<typename T, std::size_t N> class QueueSPSC {
+  public:
+    QueueSPSC() : _head(0), _tail_cached(0), _tail(0), _head_cached(0), _data() {}
+    ~QueueSPSC() {}
+
+    // Producer only.
+    bool push(T e);
+    std::size_t push(const T* e, std::size_t n);
+
+    // Consumer only.
+    bool pop(T& e);
+    std::size_t pop(T* e, std::size_t n);
+
+    bool empty(void);
+    bool full(void);
+    std::size_t size(void);
+    std::size_t capacity(void) {return N;}
+
+  private:
+    QueueSPSC(const QueueSPSC&);
+    QueueSPSC& operator=(const QueueSPSC&);
+
+    static_assert(N > 0 && (N & (N - 1)) == 0, "QueueSPSC size must be a power of two.");
+    static const std::size_t mask = N - 1;
+
+    // Consumer side.
+    alignas(64) std::atomic<std::size_t> _head;
+    std::size_t _tail_cached;
+    // Producer side.
+    alignas(64) std::atomic<std::size_t> _tail;
+    std::size_t _head_cached;
+
+    alignas(64) T _data[N];
+};
+
+template <class T, std::size_t N> inline bool QueueSPSC<T, N>::push(T e) {
+    return push(&e, 1) == 1;
+}
+
+template <class T, std::size_t N> inline std::size_t QueueSPSC<T, N>::push(const T* e, std::size_t n) {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    if (N - (tail - _head_cached) < n)
+        _head_cached = _head.load(std::memory_order_acquire);
+
+    std::size_t room = N - (tail - _head_cached);
+    std::size_t count = (n < room) ? n : room;
+    for (std::size_t i = 0; i < count; i++)
+        _data[(tail + i) & mask] = e[i];
+
+    if (count > 0)
+        _tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+template <class T, std::size_t N> inline bool QueueSPSC<T, N>::pop(T& e) {
+    return pop(&e, 1) == 1;
+}
+
+template <class T, std::size_t N> inline std::size_t QueueSPSC<T, N>::pop(T* e, std::size_t n) {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    if (_tail_cached - head < n)
+        _tail_cached = _tail.load(std::memory_order_acquire);
+
+    std::size_t avail = _tail_cached - head;
+    std::size_t count = (n < avail) ? n : avail;
+    for (std::size_t i = 0; i < count; i++)
+        e[i] = _data[(head + i) & mask];
+
+    if (count > 0)
+        _head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+template <class T, std::size_t N> inline bool QueueSPSC<T, N>::empty(void) {
+    return size() == 0;
+}
+
+template <class T, std::size_t N> inline bool QueueSPSC<T, N>::full(void) {
+    return size() >= N;
+}
+
+// NOTE: Only a snapshot, the other side may change it before it is returned.
+template <class T, std::size_t N> inline std::size_t QueueSPSC<T, N>::size(void) {
+    std::size_t head = _head.load(std::memory_order_acquire);
+    std::size_t tail = _tail.load(std::memory_order_acquire);
+    return (tail > head) ? tail - head : 0;
+}
+
+#endif // QUEUESPSC_H
@@ -0,0 +1,159 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <cstddef>  // std::size_t
+#include <cstdint>  // uint64_t
+
+
+
+// A hierarchical timing wheel with Levels levels of 2^SlotBits slots each, counting time in ticks. Level 0
+// has one slot per tick, and each level above covers 2^SlotBits times the span of the one below it, so the
+// default 4 levels of 64 slots reach 2^24 ticks ahead. Timers further out are clamped to that.
+//
+// Scheduling and cancelling are O(1). A timer goes into the level its time left fits, and is moved down one
+// level (cascaded) when the level below wraps around to the span it is in. advance() then only has to look
+// at one slot of level 0 per tick, no matter how many timers there are.
+//
+// Timers are intrusive, the caller owns them (usually by deriving from Timer) and the wheel only links them
+// into its slots. A timer must be cancelled before it is destroyed.
+//
+// NOTE: Not thread-safe.
+template<std::size_t Levels = 4, std::size_t SlotBits = 6> class TimingWheel {
+  public:
+    typedef uint64_t Tick;
+
+    class Timer {
+      public:
+        Timer() : expires(0), prev(NULL), next(NULL) {}
+
+        bool scheduled(void) const {return prev != NULL;}
+        Tick when(void) const {return expires;}
+
+      private:
+        friend class TimingWheel;
+        Tick   expires;
+        Timer* prev;
+        Timer* next;
+    };
+
+    explicit TimingWheel(Tick now = 0);
+    ~TimingWheel() {}
+
+    void schedule(Timer* t, Tick expires);  // (Re)schedules the timer, a time already passed fires next tick.
+    void cancel(Timer* t);
+
+    // Moves time forward to now, calling fire(Timer*) for every timer expiring on the way. fire() may
+    // schedule timers again, including the one it was called for.
+    template<class F> void advance(Tick now, F fire);
+
+    Tick        now(void) const {return _current;}
+    std::size_t size(void) const {return _count;}
+
+  private:
+    TimingWheel(const TimingWheel&);
+    TimingWheel& operator=(const TimingWheel&);
+
+    static const std::size_t Slots = std::size_t(1) << SlotBits;
+    static const Tick        SlotMask = Slots - 1;
+    static const Tick        MaxAhead = (Tick(1) << (SlotBits * Levels)) - 1;
+
+    void link(Timer* t);
+    void cascade(std::size_t level);
+
+    Tick        _current;               // The last tick processed.
+    std::size_t _count;
+    Timer       _slots[Levels][Slots];  // Sentinels of circular lists.
+};
+
+
+template <std::size_t L, std::size_t B> inline TimingWheel<L, B>::TimingWheel(Tick now) : _current(now), _count(0), _slots() {
+    static_assert(L > 0 && B > 0 && B * L < 64, "TimingWheel must have at least one level, and fit in 64 bits.");
+    for (std::size_t l = 0; l < L; l++) {
+        for (std::size_t s = 0; s < Slots; s++) {
+            _slots[l][s].prev = _slots[l][s].next = &_slots[l][s];
+        }
+    }
+}
+
+template <std::size_t L, std::size_t B> inline void TimingWheel<L, B>::schedule(Timer* t, Tick expires) {
+    if (t->scheduled())
+        cancel(t);
+    if (expires <= _current)
+        expires = _current + 1;
+    if (expires - _current > MaxAhead)
+        expires = _current + MaxAhead;
+    t->expires = expires;
+    link(t);
+    ++_count;
+}
+
+template <std::size_t L, std::size_t B> inline void TimingWheel<L, B>::cancel(Timer* t) {
+    if (!t->scheduled())
+        return;
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = NULL;
+    --_count;
+}
+
+// Puts the timer in the slot of the lowest level whose span holds its time left. A timer cascaded down at the
+// start of the tick it expires on ends up in the level 0 slot about to be fired.
+template <std::size_t L, std::size_t B> inline void TimingWheel<L, B>::link(Timer* t) {
+    Tick left = t->expires - _current;
+    std::size_t level = 0;
+    while (level < L - 1 && left >= (Tick(1) << (B * (level + 1))))
+        ++level;
+
+    Timer* head = &_slots[level][(t->expires >> (B * level)) & SlotMask];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+// Moves all timers of the level's current slot down to the levels below.
+template <std::size_t L, std::size_t B> inline void TimingWheel<L, B>::cascade(std::size_t level) {
+    Timer* head = &_slots[level][(_current >> (B * level)) & SlotMask];
+    Timer* t = head->next;
+    head->prev = head->next = head;
+
+    while (t != head) {
+        Timer* following = t->next;
+        link(t);
+        t = following;
+    }
+}
+
+template <std::size_t L, std::size_t B> template <class F> inline void TimingWheel<L, B>::advance(Tick now, F fire) {
+    while (_current < now) {
+        ++_current;
+
+        // NOTE: When a level wraps around, the next span of the level above moves down into it. Highest level
+        //       first, so what it moves down into a level that also wrapped is moved on down.
+        std::size_t wrapped = 0;
+        while (wrapped + 1 < L && (_current & ((Tick(1) << (B * (wrapped + 1))) - 1)) == 0)
+            ++wrapped;
+        for (std::size_t level = wrapped; level > 0; level--)
+            cascade(level);
+
+        // Detach the slot before firing, so timers scheduled again from fire() don't end up in the list we
+        // are walking.
+        Timer* head = &_slots[0][_current & SlotMask];
+        if (head->next == head)
+            continue;
+        Timer* t = head->next;
+        head->prev->next = NULL;
+        head->prev = head->next = head;
+
+        while (t != NULL) {
+            Timer* following = t->next;
+            t->prev = t->next = NULL;
+            --_count;
+            fire(t);
+            t = following;
+        }
+    }
+}
+
+
+#endif // TIMINGWHEEL_H
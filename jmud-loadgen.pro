@@ -0,0 +1,30 @@
+QT -= gui
+
+CONFIG += c++20 console
+CONFIG -= app_bundle
+
+TARGET = jmud-loadgen
+
+INCLUDEPATH += jMUD/src/utilities jMUD/src/config
+
+LIBS += -lz
+
+SOURCES += \
+    jMUD/src/tools/loadgen/CommandMix.cpp \
+    jMUD/src/tools/loadgen/LoadGenerator.cpp \
+    jMUD/src/tools/loadgen/main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+DISTFILES += \
+    jMUD/src/tools/loadgen/commands.mix
+
+HEADERS += \
+    jMUD/src/config/config.h \
+    jMUD/src/server/network/NetworkTelnet.h \
+    jMUD/src/tools/loadgen/CommandMix.h \
+    jMUD/src/tools/loadgen/LoadGenerator.h \
+    jMUD/src/utilities/Histogram.h